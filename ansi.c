@@ -0,0 +1,120 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#include "config.h"
+
+#include <string.h>	/* memchr(3) */
+
+#include "ansi.h"
+
+#include "compat/inline-restrict.h"
+#include "compat/__attribute__.h"
+
+enum { GROUND, ESC, CSI, CSI_IGNORE };
+
+static __inline__ void
+end_param(struct ansi_state *const st)
+/* Apply one SGR parameter, empty ones being 0 */
+{
+	if (st->sub) {
+		st->sub = 0;
+		return;
+	}
+
+	if (st->skip) {
+		/* 38;5;N or 38;2;R;G;B: the 5 or 2 says how many more are
+		 * just numbers, which mustn't be mistaken for eg. a 0 */
+		if (st->skip == 255)
+			st->skip = st->param == 5 ? 1 : st->param == 2 ? 3 : 0;
+		else
+			st->skip--;
+	} else switch (st->param) {
+	case 0: case 39:
+		st->fg = ANSI_FG_DEFAULT;
+		break;
+	case 38:
+		st->fg = ANSI_FG_SET;
+		/*@fallthrough@*/
+	case 48: case 58:
+		st->skip = 255; /* ie. `look at the next one' */
+		break;
+	default:
+		if ((st->param >= 30 && st->param <= 37)
+		    || (st->param >= 90 && st->param <= 97))
+			st->fg = ANSI_FG_SET;
+	}
+
+	st->param = 0;
+}
+
+extern size_t __attribute__((nonnull, __access__(read_only, 2, 3)))
+ansi_scan(struct ansi_state *__restrict__ const st,
+	const char *__restrict__ const buf, const size_t n,
+	int *__restrict__ const fg)
+/* Scans buf from where st left off, stopping just after the first SGR
+ * sequence that does anything to the foreground, which it puts in *fg.
+ * Returns how far it got: if that's n, *fg may be ANSI_FG_UNTOUCHED, and
+ * st may be left partway through a sequence. Outside of sequences, this
+ * is just memchr(3) looking for ESC, which a decent libc vectorises, so
+ * output without escapes costs next to nothing */
+{
+	size_t i = 0;
+
+	*fg = ANSI_FG_UNTOUCHED;
+
+	while (i < n) {
+		const unsigned char c = buf[i++];
+
+		switch (st->state) {
+		case GROUND: {
+			const char *const e = memchr(buf + i - 1, '\033', n - i + 1);
+			if (!e)
+				return n;
+			i = e - buf + 1;
+			st->state = ESC;
+			break;
+		}
+
+		case ESC:
+			if (c == '[') {
+				st->state = CSI;
+				st->param = st->skip = st->sub = 0;
+				st->fg = ANSI_FG_UNTOUCHED;
+			} else
+				st->state = c == '\033' ? ESC : GROUND;
+			break;
+
+		case CSI:
+			if (c >= '0' && c <= '9') {
+				if (!st->sub)
+					st->param = st->param * 10 + (c - '0');
+				break;
+			} else if (c == ';') {
+				end_param(st);
+				break;
+			} else if (c == ':') {
+				st->sub = 1;
+				break;
+			} else if (c == 'm') {
+				end_param(st);
+				st->state = GROUND;
+				if (st->fg != ANSI_FG_UNTOUCHED) {
+					*fg = st->fg;
+					return i;
+				}
+				break;
+			}
+			/* Private markers, intermediates, or another final
+			 * byte: not an SGR, so not our business */
+			st->state = CSI_IGNORE;
+			/*@fallthrough@*/
+		case CSI_IGNORE:
+			if (c >= 0x40 && c <= 0x7e)
+				st->state = GROUND;
+			else if (c == '\033')
+				st->state = ESC;
+			break;
+		}
+	}
+
+	return n;
+}
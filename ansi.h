@@ -0,0 +1,34 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef ANSI_H
+#define ANSI_H
+
+/* A streaming scanner for the child's own escape sequences, so that our
+ * colours can survive them. Only SGR (`\033[...m') is understood, and of
+ * that only what it does to the foreground colour */
+
+#include <stddef.h>
+
+#include "compat/__attribute__.h"
+
+/* What an SGR sequence did to the foreground */
+enum { ANSI_FG_UNTOUCHED, ANSI_FG_DEFAULT, ANSI_FG_SET };
+
+/* Per input stream, since a sequence may be split across reads. Zero it
+ * to start */
+struct ansi_state {
+	unsigned char state;	/* where we are in a sequence */
+	unsigned char skip;	/* parameters left belonging to a 38/48/58 */
+	unsigned char fg;	/* ANSI_FG_*, so far in this sequence */
+	unsigned char sub;	/* in a `:' subparameter, so ignoring it */
+	unsigned param;		/* so far */
+};
+
+/* Whether st is partway through a sequence, so nothing should be
+ * inserted before the next of that stream's bytes */
+#define ansi_pending(st) ((st)->state != 0)
+
+extern size_t ansi_scan(struct ansi_state *st, const char *buf, size_t n, int *fg)
+	__attribute__((nonnull, __access__(read_only, 2, 3)));
+
+#endif /* ANSI_H */
@@ -0,0 +1,296 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Microbenchmarks for the insides of ssss: drives mkprefix, sprint_time,
+ * prepend_lines and the -j escaping (by way of ssss_feed) and print_columns
+ * in-process over a few fixed corpora, so that a regression shows up as
+ * the function it's in rather than as ssss being a bit slower overall.
+ * `make bench' builds it. Output is tab-separated, one line per function
+ * and corpus, headed with the version from config.h, so runs from
+ * different commits can be joined up with eg. join(1) or awk(1):
+ *
+ *	$ ./bench > before.tsv
+ *	$ git checkout ...; make bench; ./bench > after.tsv
+ *
+ * The corpora are generated from a fixed seed, so they're the same every
+ * time. Times are from the median of the repetitions, after warm-up */
+#include "config.h"
+
+#if _POSIX_C_SOURCE < 199309L
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>	/* malloc(3), qsort(3), atoi(3) */
+#include <string.h>
+#include <time.h>	/* clock_gettime(2) */
+
+#include <err.h>
+#include <unistd.h>	/* getopt(3) */
+
+#include "libssss.h"
+#include "column-in-technicolour.h"
+#include "prefix.h"
+#include "timestamp.h"
+
+#include "compat/__attribute__.h"
+
+#define MAXREPS 1000
+
+struct corpus {
+	const char *name;
+	char *buf;
+	size_t len, lines;
+};
+
+/* Somewhere for output to go that the compiler can't see through */
+static volatile size_t sunk;
+
+static void
+sink(void *ctx __attribute__((unused)), int ofd __attribute__((unused)),
+	const struct iovec *const iov, const int iovcnt)
+{
+	int i;
+	for (i = 0; i < iovcnt; i++)
+		sunk += iov[i].iov_len;
+}
+
+static unsigned long rng = 1;
+
+static unsigned
+rnd(const unsigned n)
+/* Not a good one, but the same one everywhere */
+{
+	rng = rng * 1103515245 + 12345;
+	return (rng >> 16) % n;
+}
+
+static size_t
+put_utf8(char *const p, const unsigned long c)
+{
+	if (c < 0x80) {
+		p[0] = c;
+		return 1;
+	} else if (c < 0x10000) {
+		p[0] = 0xe0 | c >> 12;
+		p[1] = 0x80 | (c >> 6 & 0x3f);
+		p[2] = 0x80 | (c & 0x3f);
+		return 3;
+	} else {
+		p[0] = 0xf0 | c >> 18;
+		p[1] = 0x80 | (c >> 12 & 0x3f);
+		p[2] = 0x80 | (c >> 6 & 0x3f);
+		p[3] = 0x80 | (c & 0x3f);
+		return 4;
+	}
+}
+
+enum { ASCII_SHORT, ASCII_LONG, UTF8, BINARY, NCORPORA };
+
+static void __attribute__((nonnull))
+mkcorpus(struct corpus *const c, const int kind, const size_t size)
+{
+	static const char *const names[NCORPORA] = {
+		"ascii-short", "ascii-long", "utf8-cjk-emoji", "binary"
+	};
+	size_t i = 0;
+
+	c->name = names[kind];
+	c->lines = 0;
+	c->buf = malloc(size + 4);
+	if (!c->buf)
+		err(-1, NULL);
+
+	rng = 1 + kind;
+	while (i < size) {
+		size_t linelen;
+		switch (kind) {
+		case ASCII_SHORT:
+		case ASCII_LONG:
+			linelen = kind == ASCII_SHORT ? 8 + rnd(32) : 1000 + rnd(3000);
+			for (; linelen-- && i < size; i++)
+				c->buf[i] = ' ' + rnd('~' - ' ' + 1);
+			break;
+		case UTF8:
+			for (linelen = 10 + rnd(50); linelen-- && i < size;)
+				switch (rnd(3)) {
+				case 0:	c->buf[i++] = 'a' + rnd(26); break;
+				case 1:	i += put_utf8(c->buf + i, 0x4e00 + rnd(0x5000)); break;
+				case 2:	i += put_utf8(c->buf + i, 0x1f600 + rnd(0x50)); break;
+				}
+			break;
+		case BINARY:
+			for (; i < size; i++) {
+				c->buf[i] = rnd(256);
+				if (c->buf[i] == '\n')
+					c->buf[i] = '\0';
+			}
+			continue;
+		}
+		if (i < size)
+			c->buf[i++] = '\n', c->lines++;
+	}
+	c->len = i;
+}
+
+static double
+now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/* What's being timed, over one corpus. Returns how many calls it made
+ * that count as `lines' (eg. for mkprefix), with how many bytes they made
+ * between them in *bytes; or 0 to use corpus->lines and corpus->len */
+typedef size_t bench_fn(const struct corpus *, unsigned char flags, size_t *bytes);
+
+#define NCALLS 100000
+
+static size_t
+bench_mkprefix(const struct corpus *c __attribute__((unused)), const unsigned char flags,
+	size_t *const bytes)
+{
+	char prefix[TIMESTAMP_SIZE + 3];
+	size_t i, n = 0;
+	for (i = 0; i < NCALLS; i++)
+		n += mkprefix(flags, 1 + (i & 1), prefix);
+	sunk += n;
+	*bytes = n;
+	return NCALLS;
+}
+
+static size_t
+bench_sprint_time(const struct corpus *c __attribute__((unused)),
+	const unsigned char flags __attribute__((unused)), size_t *const bytes)
+{
+	char buf[TIMESTAMP_SIZE];
+	size_t i;
+	for (i = 0; i < NCALLS; i++) {
+		sprint_time(buf);
+		sunk += buf[10];
+	}
+	*bytes = NCALLS * (TIMESTAMP_SIZE - 1);
+	return NCALLS;
+}
+
+static size_t
+bench_feed(const struct corpus *const c, const unsigned char flags,
+	size_t *const bytes __attribute__((unused)))
+/* prepend_lines and friends, in read(2)-sized chunks, as ssss does */
+{
+	struct ssss *const s = ssss_new(flags, sink, NULL);
+	size_t i;
+	for (i = 0; i < c->len; i += BUFSIZ)
+		ssss_feed(s, 1 + (i / BUFSIZ & 1), c->buf + i,
+			c->len - i < BUFSIZ ? c->len - i : BUFSIZ);
+	ssss_free(s);
+	return 0;
+}
+
+static size_t
+bench_print_columns(const struct corpus *const c, const unsigned char flags,
+	size_t *const bytes __attribute__((unused)))
+/* The same corpus down both sides */
+{
+	struct columns *const col = columns_new();
+	size_t i;
+	for (i = 0; i < c->len; i += BUFSIZ) {
+		const size_t n = c->len - i < BUFSIZ ? c->len - i : BUFSIZ;
+		columns_feed(col, 1, c->buf + i, n);
+		columns_feed(col, 2, c->buf + i, n);
+		print_columns(col, 160, flags, sink, NULL);
+	}
+	columns_free(col);
+	return 0;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+	const double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void __attribute__((nonnull))
+run(const char *const name, bench_fn *const fn, const unsigned char flags,
+	const struct corpus *const c, const int warmup, const int reps)
+{
+	static double times[MAXREPS];
+	size_t calls = 0, bytes = 0;
+	double med;
+	int i, percall;
+
+	for (i = 0; i < warmup; i++)
+		fn(c, flags, &bytes);
+	for (i = 0; i < reps; i++) {
+		const double t0 = now();
+		calls = fn(c, flags, &bytes);
+		times[i] = now() - t0;
+	}
+	qsort(times, reps, sizeof *times, cmp_double);
+	med = times[reps / 2];
+
+	/* For the per-call benchmarks, bytes are what the calls made, as
+	 * they said; else they're the corpus' */
+	percall = calls != 0;
+	if (!percall)
+		bytes = c->len, calls = c->lines;
+
+	printf("%s\t%s\t%s\t%lu\t%lu\t%d\t%.0f\t%.0f\t%.4f\t%.2f\n",
+		SSSS_VERSION, name, percall ? "-" : c->name,
+		(unsigned long)bytes, (unsigned long)calls, reps,
+		times[0], med, med / bytes, calls ? med / calls : 0.0);
+	fflush(stdout);
+}
+
+int
+main(const int argc, char *const *const argv)
+{
+	struct corpus corpora[NCORPORA];
+	size_t size = 1 << 20;
+	int warmup = 2, reps = 10, i, o;
+
+	while ((o = getopt(argc, argv, "r:s:w:")) != -1)
+		switch (o) {
+		case 'r':	reps = atoi(optarg); break;
+		case 's':	size = strtoul(optarg, NULL, 0); break;
+		case 'w':	warmup = atoi(optarg); break;
+		default:
+			fprintf(stderr, "Usage: %s [-r REPS] [-s CORPUS_BYTES] [-w WARMUP_REPS]\n",
+				argv[0]);
+			return -1;
+		}
+	if (reps < 1 || reps > MAXREPS)
+		errx(-1, "-r: must be from 1 to %d", MAXREPS);
+
+	/* mbrlen(3) in print_columns wants a UTF-8 locale to be fair to the
+	 * UTF-8 corpus */
+	setlocale(LC_ALL, "");
+	if (MB_CUR_MAX == 1 && !setlocale(LC_ALL, "C.UTF-8"))
+		warnx("no UTF-8 locale; print_columns will see bytes as characters");
+
+	for (i = 0; i < NCORPORA; i++)
+		mkcorpus(&corpora[i], i, size);
+
+	puts("version\tbench\tcorpus\tbytes\tlines\treps\tmin_ns\tmedian_ns\tns_per_byte\tns_per_line");
+
+	run("mkprefix-p", bench_mkprefix, FLAG_PREFIX, corpora, warmup, reps);
+	run("mkprefix-tp", bench_mkprefix, FLAG_PREFIX | FLAG_TIMESTAMPS, corpora, warmup, reps);
+	run("sprint_time", bench_sprint_time, 0, corpora, warmup, reps);
+
+	for (i = 0; i < NCORPORA; i++) {
+		run("prepend_lines-p", bench_feed, FLAG_PREFIX, &corpora[i], warmup, reps);
+		run("prepend_lines-tp", bench_feed, FLAG_PREFIX | FLAG_TIMESTAMPS, &corpora[i], warmup, reps);
+		run("prepend_lines-cp", bench_feed, FLAG_PREFIX | FLAG_COLOUR, &corpora[i], warmup, reps);
+		run("passthrough-c", bench_feed, FLAG_COLOUR, &corpora[i], warmup, reps);
+		run("json", bench_feed, FLAG_JSON, &corpora[i], warmup, reps);
+		run("print_columns", bench_print_columns, 0, &corpora[i], warmup, reps);
+		free(corpora[i].buf);
+	}
+
+	return 0;
+}
@@ -2,42 +2,21 @@
 
 #include <assert.h>
 #include <errno.h>
-#include <stdio.h>
+#include <stdio.h>  /* BUFSIZ */
 #include <stdlib.h> /* realloc(3), free(3) */
-#include <wchar.h>
+#include <string.h> /* memcpy(3), memmove(3), memset(3) */
+#include <wchar.h>  /* mbrlen(3) */
 
 #include <err.h>
 
-#ifdef HAVE_SYS_IOCTL_H
-#include <sys/ioctl.h>
-#elif defined HAVE_IOCTL_H
-#include <ioctl.h>
-#elif defined HAVE_STROPTS_H
-#include <stropts.h>
-#else
-#define NO_IOCTL
-#endif /* HAVE_SYS_IOCTL_H */
-#ifndef NO_IOCTL
-#include <signal.h>
-#endif /* NO_IOCTL */
-
 #include "column-in-technicolour.h"
-#include "process_cmdline.h"
 #include "timestamp.h"
 
-#include "compat/unlocked-stdio.h"
 #include "compat/bool.h"
 #include "compat/ckdint.h"
 #include "compat/inline-restrict.h"
 #include "compat/__attribute__.h"
 
-#ifndef STDOUT_FILENO
-#define STDOUT_FILENO 1
-#endif
-#ifndef STDERR_FILENO
-#define STDERR_FILENO 2
-#endif
-
 static void * __attribute__((returns_nonnull))
 xreallocbuf(void * ptr, const size_t nmemb, const size_t size)
 /* like glibc reallocarray(3), but sets errno to EOVERFLOW */
@@ -60,97 +39,119 @@ fail:		err(-1, NULL);
 
 #define XREALLOCBUF(ptr, size) (ptr = xreallocbuf(ptr, size, sizeof *ptr))
 
-static bool
-watch_file(FILE *const file)
-/* determines whether to keep watching file after eg. fgetws(3) returns NULL */
-{
-	if (feof(file))
-		return false;
-	assert(ferror(file));
-	return errno == EAGAIN; /* if EAGAIN, keep watching */
-}
+/* Bytes fed from one stream and not yet printed */
+struct colbuf {
+	char *buf;
+	size_t len, cap;
+	mbstate_t mbs;
+};
 
-static bool
-get_wline_or_eof(
-	wchar_t *__restrict__ const outbuf,
-	const int cols,
-	FILE *__restrict__ const stream,
-	const int fd,
-	int *__restrict__ const watch
-) {
-	const bool ret = !!fgetws(outbuf, cols, stream);
-
-	if (ret) {
-		/* Not too happy about having to make all these passes */
-		const size_t len = wcslen(outbuf);
-		if (len && outbuf[len - 1] == L'\n')
-			outbuf[len - 1] = '\0';
-	} else {
-		*outbuf = L'\0';
-		if (!watch_file(stream))
-			*watch &= ~fd;
-	}
+struct columns {
+	struct colbuf in[2];	/* indexed by fd - 1 */
+	struct colbuf out;	/* the rows, as they're built */
+};
 
-	return ret;
+static void __attribute__((nonnull, __access__(read_only, 2, 3)))
+colbuf_append(struct colbuf *const b, const char *const p, const size_t n)
+{
+	if (b->cap - b->len < n) {
+		while (b->cap - b->len < n)
+			b->cap = b->cap ? b->cap * 2 : BUFSIZ;
+		XREALLOCBUF(b->buf, b->cap);
+	}
+	memcpy(b->buf + b->len, p, n);
+	b->len += n;
 }
 
-/* this is set from TIOCGWINSZ(2const), from a struct winsize .ws_col, an
- * unsigned short, so it is initialised to a value which it cannot have
- * been set to */
-static volatile int ncolumns = -1;
-
-#ifdef TIOCGWINSZ
-static void
-handler_set_ncolumns(int sigwinch __attribute__((unused)))
+static void __attribute__((nonnull))
+colbuf_pad(struct colbuf *const b, int n)
 {
-	struct winsize ws;
-	if (ioctl(fileno(stdout), TIOCGWINSZ, &ws) == 0)
-		ncolumns = ws.ws_col;
-	else
-		warn("ioctl(2)");
+	static const char spaces[] = "                                ";
+	for (; n > 0; n -= sizeof spaces - 1)
+		colbuf_append(b, spaces,
+			n < (int)sizeof spaces - 1 ? (size_t)n : sizeof spaces - 1);
 }
-#endif
 
-static int /* unsigned short, mayhaps? */
-ncolumns_init(void)
+static size_t __attribute__((nonnull))
+next_line(
+	struct colbuf *__restrict__ const b,
+	const size_t off,
+	const int maxchars,
+	size_t *__restrict__ const textlen,
+	int *__restrict__ const nchars
+)
+/* The push-based equivalent of fgetws(3) with a buffer of maxchars + 1:
+ * finds the next line in b starting from off, of up to maxchars
+ * characters. Returns how many bytes it takes up, including any newline,
+ * which *textlen doesn't; 0 if there's nothing (complete) to take.
+ * Advances b->mbs over it */
 {
-#ifdef TIOCGWINSZ
-	{
-		struct winsize ws;
-		if (ioctl(fileno(stdout), TIOCGWINSZ, &ws) == 0) {
-			struct sigaction sa = { 0 };
-			sa.sa_handler = handler_set_ncolumns;
-			if (sigaction(SIGWINCH, &sa, NULL) != 0)
-				warn("sigaction(2)");
-			return ws.ws_col;
+	size_t i = off;
+	int c = 0;
+
+	while (i < b->len && c < maxchars) {
+		const mbstate_t before = b->mbs;
+		size_t k;
+
+		if (b->buf[i] == '\n')
+			break;
+
+		switch ((k = mbrlen(b->buf + i, b->len - i, &b->mbs))) {
+		case (size_t)-2:
+			/* Incomplete character; wait for the rest */
+			b->mbs = before;
+			goto out;
+		case (size_t)-1:
+			/* Invalid; one byte, one column, like a replacement
+			 * character will be */
+			memset(&b->mbs, 0, sizeof b->mbs);
+			/*@fallthrough@*/
+		case 0:	k = 1;
 		}
+		i += k, c++;
 	}
-	if (errno != ENOTTY)
-		warn("ioctl(2)");
-#endif
 
-	{
-		const char *__restrict__ const env_ncols = getenv("COLUMNS");
-		const int res = env_ncols ? atoi(env_ncols) : 0;
-		if (res > 0) /* && res < USHRT_MAX ? */
-			return res;
-	}
+out:	*textlen = i - off;
+	*nchars = c;
+	/* Eat the newline too, even if the line just fit, rather than
+	 * leaving it to make a blank row by itself */
+	if (i < b->len && b->buf[i] == '\n')
+		i++;
+	return i - off;
+}
 
-	/* if all else fails, default to the good old */
-	return 80;
+extern struct columns * __attribute__((malloc, returns_nonnull))
+columns_new(void)
+{
+	struct columns *const c = xreallocbuf(NULL, 1, sizeof *c);
+	memset(c, 0, sizeof *c);
+	return c;
+}
+
+extern void __attribute__((nonnull))
+columns_free(struct columns *const c)
+{
+	free(c->in[0].buf);
+	free(c->in[1].buf);
+	free(c->out.buf);
+	free(c);
 }
 
-/* TODO: respect values of watch in the parent loop so we don't repeatedly
- * make system calls to read(2) just to get EAGAIN every time. Or should we?
- * Is it worth checking every time? */
-static int
+extern void __attribute__((nonnull, __access__(read_only, 3, 4)))
+columns_feed(struct columns *const c, const int fd, const char *const buf, const size_t n)
+{
+	assert(fd == 1 || fd == 2);
+	colbuf_append(&c->in[fd - 1], buf, n);
+}
+
+extern void __attribute__((nonnull(1, 4)))
 print_columns (
-	FILE *__restrict__ const o,
-	FILE *__restrict__ const e,
-	const unsigned char flags
+	struct columns *__restrict__ const c,
+	const int width,
+	const unsigned char flags,
+	ssss_write_fn *const write,
+	void *const ctx
 ) {
-	static wchar_t *__restrict__ obuf = NULL, *__restrict__ ebuf = NULL;
-	static int prev_cols = -1; /* see comment on initialisation of ncolumns */
 	char timestamp[TIMESTAMP_SIZE] = "";
 	const char
 		*const red	= (flags & FLAG_COLOUR) ? "\033[31m" : "",
@@ -159,46 +160,49 @@ print_columns (
 			((flags & (FLAG_COLOUR | FLAG_TIMESTAMPS)) == (FLAG_COLOUR | FLAG_TIMESTAMPS))
 			? "\033[m"
 			: "";
-	int watch = STDOUT_FILENO | STDERR_FILENO;
-
-	/* this is the only time that ncolumns is referenced at all (a
-	 * read), so this is hopefully async-signal-safe (assuming ofc that
-	 * the read itself cannot be interrupted, which it surely can't
-	 * be..?) */
-	const int cols = (ncolumns - (TIMESTAMP_SIZE * !!(flags & FLAG_TIMESTAMPS))) / 2;
+	int cols = (width - (int)(TIMESTAMP_SIZE * !!(flags & FLAG_TIMESTAMPS))) / 2;
+	size_t ooff = 0, eoff = 0;
 
-	if (cols != prev_cols)
-		XREALLOCBUF(obuf, cols), XREALLOCBUF(ebuf, cols),
-		prev_cols = cols;
+	if (cols < 2)
+		cols = 2;
 
-	/* should this be repeated on each loop? */
+	/* should this be repeated on each row? */
 	if (flags & FLAG_TIMESTAMPS)
 		sprint_time(timestamp);
 
-	/* TODO: reset cols every loop if SIGWINCH has been (terminfo?) */
-	while (get_wline_or_eof(obuf, cols, o, STDOUT_FILENO, &watch)
-	    || get_wline_or_eof(ebuf, cols, e, STDERR_FILENO, &watch))
-		wprintf(L"%s%s" L"%s%-*ls" L"%s%-*ls" L"\n",
-			nocolour, timestamp,
-			green, cols, obuf,
-			red, cols, ebuf);
-
-	return watch;
-}
-
-extern int
-ugly_column_hack(const int ofd, const int efd, const unsigned char flags)
-/* TODO: when the filestreams are opened, register a function to close them
- * with atexit(3)? */
-{
-	static const char mode[] = "r";
-	static FILE *__restrict__ o = NULL, *__restrict__ e = NULL;
-
-	if (!((o || (o = fdopen(ofd, mode))) && (e || (e = fdopen(efd, mode))))) /* woowee */
-		err(-1, NULL);
-
-	if (ncolumns == -1)
-		ncolumns = ncolumns_init();
+	c->out.len = 0;
+	for (;;) {
+		size_t olen, elen;
+		int ochars, echars;
+		const size_t on = next_line(&c->in[0], ooff, cols - 1, &olen, &ochars),
+			en = next_line(&c->in[1], eoff, cols - 1, &elen, &echars);
+
+		if (!on && !en)
+			break;
+
+		colbuf_append(&c->out, nocolour, strlen(nocolour));
+		colbuf_append(&c->out, timestamp, strlen(timestamp));
+		colbuf_append(&c->out, green, strlen(green));
+		colbuf_append(&c->out, c->in[0].buf + ooff, olen);
+		colbuf_pad(&c->out, cols - ochars);
+		colbuf_append(&c->out, red, strlen(red));
+		colbuf_append(&c->out, c->in[1].buf + eoff, elen);
+		colbuf_pad(&c->out, cols - echars);
+		colbuf_append(&c->out, "\n", 1);
+
+		ooff += on, eoff += en;
+	}
 
-	return print_columns(o, e, flags);
+	/* Keep anything incomplete for next time */
+	if (ooff)
+		memmove(c->in[0].buf, c->in[0].buf + ooff, c->in[0].len -= ooff);
+	if (eoff)
+		memmove(c->in[1].buf, c->in[1].buf + eoff, c->in[1].len -= eoff);
+
+	if (c->out.len) {
+		struct iovec iov;
+		iov.iov_base = c->out.buf;
+		iov.iov_len = c->out.len;
+		write(ctx, 1, &iov, 1);
+	}
 }
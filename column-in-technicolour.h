@@ -1,9 +1,21 @@
 #ifndef COLUMN_IN_TECHNILCOLOUR_H
 #define COLUMN_IN_TECHNILCOLOUR_H
 
-/* this was originally to be named as the header is, but I don't to imply
- * compatibility with the CAT_IN_TECHNICOLOUR functions in ssss.c. Its
- * `temporary' working name seems more apposite */
-extern int ugly_column_hack(int, int, unsigned char);
+/* -S, for libssss.c. This was originally to be named as the header is, but
+ * I don't to imply compatibility with the CAT_IN_TECHNICOLOUR functions.
+ * Its `temporary' working name seems more apposite */
+
+#include <stddef.h>
+
+#include "libssss.h"
+
+struct columns;
+
+extern struct columns *columns_new(void) __attribute__((malloc, returns_nonnull));
+extern void columns_free(struct columns *) __attribute__((nonnull));
+extern void columns_feed(struct columns *, int fd, const char *, size_t)
+	__attribute__((nonnull, __access__(read_only, 3, 4)));
+extern void print_columns(struct columns *, int width, unsigned char flags,
+		ssss_write_fn *, void *) __attribute__((nonnull(1, 4)));
 
 #endif
@@ -0,0 +1,31 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef COMPAT_SDT_H
+#define COMPAT_SDT_H
+
+/* Statically defined tracepoints, for bpftrace(8), perf(1) and anything
+ * else that understands systemtap's <sys/sdt.h>. Each compiles to a nop
+ * and a note in the ELF; without <sys/sdt.h> (see configure.sh), to
+ * nothing at all. The provider is `ssss', and the probes are:
+ *
+ *	read(fd, bytes)			ssss.c, each read(2) from the child
+ *	format__start(fd, bytes)	libssss.c, ssss_feed
+ *	format__end(fd, bytes)		libssss.c, ssss_feed
+ *	write(ofd, bytes)		ssss.c, each writev(2) or fflush(3)
+ *	wakeup(nready)			ssss.c, select(2) returning
+ *	child__exit(pid, status)	ssss.c, the child reaped
+ *
+ * eg. bpftrace -e 'usdt:./ssss:ssss:read { @[arg0] = hist(arg1) }'
+ *
+ * No variadic macros, so as to stay C89 */
+
+#ifdef HAVE_SYS_SDT_H
+# include <sys/sdt.h>
+# define PROBE1(name, a)	DTRACE_PROBE1(ssss, name, a)
+# define PROBE2(name, a, b)	DTRACE_PROBE2(ssss, name, a, b)
+#else
+# define PROBE1(name, a)	((void)0)
+# define PROBE2(name, a, b)	((void)0)
+#endif
+
+#endif /* COMPAT_SDT_H */
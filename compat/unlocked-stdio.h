@@ -0,0 +1,32 @@
+/* Auto-generated by configure.sh */
+#ifndef UNLOCKED_STDIO_H
+#define UNLOCKED_STDIO_H
+
+#include <stdio.h>
+#include <wchar.h>
+
+# define    fflush	fflush_unlocked
+# define    getc	getc_unlocked
+# define    getchar	getchar_unlocked
+# define    fgetc	fgetc_unlocked
+# define    fputc	fputc_unlocked
+# define    putc	putc_unlocked
+# define    putchar	putchar_unlocked
+# define    fgets	fgets_unlocked
+# define    fputs	fputs_unlocked
+# define    fread	fread_unlocked
+# define    fwrite	fwrite_unlocked
+# define    clearerr	clearerr_unlocked
+# define    feof	feof_unlocked
+# define    ferror	ferror_unlocked
+# define    fileno	fileno_unlocked
+# define    getwc	getwc_unlocked
+# define    getwchar	getwchar_unlocked
+# define    fgetwc	fgetwc_unlocked
+# define    fputwc	fputwc_unlocked
+# define    putwc	putwc_unlocked
+# define    putwchar	putwchar_unlocked
+# define    fgetws	fgetws_unlocked
+# define    fputws	fputws_unlocked
+
+#endif
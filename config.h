@@ -0,0 +1,18 @@
+/* Auto-generated by configure.sh */
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define SSSS_VERSION "v0.4.2"
+
+#define HAVE_STRSIGNAL
+#define HAVE_SYS_SELECT_H
+#define HAVE_SYS_SIGNALFD_H
+#define HAVE_SYS_IOCTL_H
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+#define _GNU_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 500
+
+#endif /* CONFIG_H */
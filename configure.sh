@@ -6,7 +6,8 @@
 # Supported in this script:
 # - strsignal(3) or sys_siglist[]
 # - unlocked_stdio(3)
-# - headers: <sys/select.h>, <sys/ioctl.h> or <ioctl.h> or <stropts.h>
+# - headers: <sys/select.h>, <sys/ioctl.h> or <ioctl.h> or <stropts.h>,
+#   <sys/sdt.h> (compat/sdt.h), <sys/signalfd.h>
 #
 # Supported in preprocessor chicanery in the source code:
 # - __attribute__
@@ -147,6 +148,18 @@ config_h() {
 		chat "<sys/select.h> not found; probably nbd"
 	fi
 
+	if have_header 'sys/signalfd.h'; then
+		chat "<sys/signalfd.h> found"
+	else
+		chat "<sys/signalfd.h> not found; signals will come by pipe"
+	fi
+
+	if have_header 'sys/sdt.h'; then
+		chat "<sys/sdt.h> found; USDT probes enabled"
+	else
+		chat "<sys/sdt.h> not found; no USDT probes"
+	fi
+
 	ioctl_headers='sys/ioctl.h ioctl.h stropts.h'
 	for ioctl in $ioctl_headers ''; do
 		if test -z "$ioctl"; then
@@ -0,0 +1,478 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#include "config.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>	/* sigprocmask(2), sigtimedwait(2) */
+#include <stdlib.h>	/* calloc(3), realloc(3), free(3) */
+#include <string.h>	/* memcpy(3), memmove(3) */
+#include <time.h>	/* struct timespec, clock_gettime(2) */
+
+#include <err.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fanout.h"
+#include "libssss.h"
+#include "process_cmdline.h"
+#include "timestamp.h"
+
+#include "compat/bool.h"
+#include "compat/inline-restrict.h"
+#include "compat/__attribute__.h"
+
+#define BACKLOG	(4 * 1024 * 1024) /* per sink; writes past this are dropped */
+
+struct sink {
+	const char *path;
+	int fd;		/* -1 once given up on */
+	bool pipe;	/* a FIFO or a socket, that can EPIPE */
+
+	/* buf[head..len) is queued */
+	char *buf;
+	size_t cap, len, head;
+	unsigned long dropped;
+
+	/* A file, which O_NONBLOCK does nothing for, is written on a thread
+	 * of its own, as lzwriter does, so that a slow disk holds up nothing
+	 * else. It takes the queue whole, and leaves spare in its place to
+	 * be filled while it writes; all of which is under lock */
+	bool file;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	char *spare;
+	size_t spare_cap, writing;
+	bool closing;
+	int error;	/* an errno, once the thread's given up */
+};
+
+/* Sinks formatted the same, and the formatter they share -- or NULL for
+ * the group that gets a copy of ssss' own output */
+struct group {
+	struct ssss *fmt;
+	unsigned char flags;
+	struct sink **sinks;
+	int nsinks;
+};
+
+static struct sink *sinks;
+static struct group *groups;
+static int ngroups;
+
+static void __attribute__((nonnull))
+give_up(struct sink *const s, const char *const why)
+{
+	warn("%s: %s; no more output to it", s->path, why);
+	close(s->fd);
+	s->fd = -1;
+	s->len = s->head = 0;
+}
+
+static ssize_t __attribute__((nonnull))
+put(struct sink *const s, const struct iovec *const iov, const int iovcnt)
+/* writev(2) that won't SIGPIPE us for the sake of a sink: stdout's
+ * SIGPIPE is still as fatal as ever */
+{
+	sigset_t pipe, old;
+	ssize_t n;
+
+	if (!s->pipe)
+		return writev(s->fd, iov, iovcnt);
+
+	sigemptyset(&pipe);
+	sigaddset(&pipe, SIGPIPE);
+	sigprocmask(SIG_BLOCK, &pipe, &old);
+	n = writev(s->fd, iov, iovcnt);
+	if (n == -1 && errno == EPIPE && !sigismember(&old, SIGPIPE)) {
+		/* Take it before it's unblocked and goes off */
+		const struct timespec now = { 0, 0 };
+		sigtimedwait(&pipe, NULL, &now);
+		errno = EPIPE;
+	}
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	return n;
+}
+
+static void *
+write_file(void *const arg)
+/* A file sink's thread */
+{
+	struct sink *const s = arg;
+
+	pthread_mutex_lock(&s->lock);
+	for (;;) {
+		char *const buf = s->buf;
+		const size_t cap = s->cap;
+		const char *p = buf + s->head;
+		size_t n = s->len - s->head;
+		int e = 0;
+
+		if (!n) {
+			if (s->closing)
+				break;
+			pthread_cond_wait(&s->cond, &s->lock);
+			continue;
+		}
+		s->buf = s->spare, s->cap = s->spare_cap;
+		s->len = s->head = 0;
+		s->writing = n;
+		pthread_mutex_unlock(&s->lock);
+
+		while (n) {
+			const ssize_t k = write(s->fd, p, n);
+			if (k == -1) {
+				if (errno == EINTR)
+					continue;
+				e = errno;
+				break;
+			}
+			p += k, n -= k;
+		}
+
+		pthread_mutex_lock(&s->lock);
+		s->spare = buf, s->spare_cap = cap;
+		s->writing = 0;
+		pthread_cond_broadcast(&s->cond);
+		if ((s->error = e))
+			break;
+	}
+	pthread_mutex_unlock(&s->lock);
+	return NULL;
+}
+
+static void __attribute__((nonnull))
+enqueue(struct sink *const s, const struct iovec *const iov, const int iovcnt)
+{
+	size_t total = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		total += iov[i].iov_len;
+	if (s->len - s->head + total > BACKLOG) {
+		s->dropped += total;
+		return;
+	}
+
+	if (s->cap - s->len < total) {
+		/* Make room by discarding what's written first */
+		if (s->head) {
+			memmove(s->buf, s->buf + s->head, s->len - s->head);
+			s->len -= s->head;
+			s->head = 0;
+		}
+		while (s->cap - s->len < total)
+			s->cap = s->cap ? s->cap * 2 : 64 * 1024;
+		if (!(s->buf = realloc(s->buf, s->cap)))
+			err(-1, NULL);
+	}
+
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(s->buf + s->len, iov[i].iov_base, iov[i].iov_len);
+		s->len += iov[i].iov_len;
+	}
+}
+
+static void __attribute__((nonnull))
+drain(struct sink *const s)
+/* As much of the queue as the sink will take right now; for a file, only
+ * whether its thread's given up */
+{
+	struct iovec iov;
+	ssize_t n;
+
+	if (s->file && s->fd != -1) {
+		int e;
+		pthread_mutex_lock(&s->lock);
+		e = s->error;
+		pthread_mutex_unlock(&s->lock);
+		if (e) {
+			errno = e;
+			give_up(s, "write(2)");
+		}
+		return;
+	}
+	if (s->fd == -1 || s->head == s->len)
+		return;
+	iov.iov_base = s->buf + s->head;
+	iov.iov_len = s->len - s->head;
+	if ((n = put(s, &iov, 1)) == -1) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			give_up(s, "write(2)");
+		return;
+	}
+	s->head += n;
+	if (s->head == s->len)
+		s->head = s->len = 0;
+}
+
+static void __attribute__((nonnull))
+write_group(void *const ctx, const int ofd __attribute__((unused)),
+		const struct iovec *const iov, const int iovcnt)
+/* ssss_write_fn: into the queue of each sink, for fanout_flush to write
+ * out in one go each time round, rather than a line at a time */
+{
+	const struct group *const g = ctx;
+	int i;
+
+	for (i = 0; i < g->nsinks; i++) {
+		struct sink *const s = g->sinks[i];
+		if (s->fd == -1)
+			continue;
+		if (!s->file) {
+			enqueue(s, iov, iovcnt);
+			continue;
+		}
+		pthread_mutex_lock(&s->lock);
+		enqueue(s, iov, iovcnt);
+		pthread_cond_signal(&s->cond);
+		pthread_mutex_unlock(&s->lock);
+	}
+}
+
+extern void __attribute__((nonnull))
+fanout_tee(void *const ctx, const struct iovec *const iov, const int iovcnt)
+{
+	write_group(ctx, STDOUT_FILENO, iov, iovcnt);
+}
+
+extern void *
+fanout_open(const unsigned char flags)
+{
+	/* What makes no difference to the formatter */
+	const unsigned char ours = flags & ~(FLAG_VERBOSE | FLAG_QUIET);
+	void *tee = NULL;
+	int i, j;
+
+	if (!(sinks = calloc(opts.nsinks, sizeof *sinks))
+	    || !(groups = calloc(opts.nsinks, sizeof *groups)))
+		err(-1, NULL);
+
+	for (i = 0; i < opts.nsinks; i++) {
+		struct sink *const s = &sinks[i];
+		struct group *g;
+		struct stat st;
+
+		s->path = opts.sinks[i].path;
+		s->fd = open(s->path, O_WRONLY | O_CREAT | O_APPEND | O_NONBLOCK, 0666);
+		if (s->fd == -1 || fstat(s->fd, &st))
+			err(-1, "%s", s->path);
+		if (s->fd >= FD_SETSIZE)
+			errx(-1, "%s: too many files open already for select(2)", s->path);
+		fcntl(s->fd, F_SETFD, FD_CLOEXEC);
+		s->pipe = !S_ISREG(st.st_mode) && !S_ISCHR(st.st_mode);
+		if ((s->file = S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))) {
+			/* As for lzwriter's: signals are the main thread's */
+			sigset_t all, old;
+			pthread_mutex_init(&s->lock, NULL);
+			pthread_cond_init(&s->cond, NULL);
+			sigfillset(&all);
+			pthread_sigmask(SIG_SETMASK, &all, &old);
+			if ((errno = pthread_create(&s->thread, NULL, write_file, s)))
+				err(-1, "pthread_create(3)");
+			pthread_sigmask(SIG_SETMASK, &old, NULL);
+		}
+
+		for (j = 0; j < ngroups; j++)
+			if (groups[j].flags == opts.sinks[i].flags)
+				break;
+		g = &groups[j];
+		if (j == ngroups) {
+			ngroups++;
+			g->flags = opts.sinks[i].flags;
+			if (!(g->sinks = calloc(opts.nsinks, sizeof *g->sinks)))
+				err(-1, NULL);
+			/* Our own output is only the same as a sink's if it's
+			 * all going to the one place too */
+			if (g->flags == ours)
+				tee = g;
+			else {
+				g->fmt = ssss_new(g->flags, write_group, g);
+				if (opts.group_ms)
+					ssss_set_grouping(g->fmt, opts.group_ms,
+						opts.group_prefixes);
+			}
+		}
+		g->sinks[g->nsinks++] = s;
+	}
+
+	return tee;
+}
+
+extern void __attribute__((nonnull, __access__(read_only, 2, 3)))
+fanout_feed(const int fd, const char *const buf, const size_t n)
+{
+	int i;
+	for (i = 0; i < ngroups; i++)
+		if (groups[i].fmt)
+			ssss_feed(groups[i].fmt, fd, buf, n);
+}
+
+extern void
+fanout_flush(void)
+{
+	int i;
+	for (i = 0; i < ngroups; i++)
+		if (groups[i].fmt)
+			ssss_flush(groups[i].fmt);
+	for (i = 0; i < opts.nsinks; i++)
+		drain(&sinks[i]);
+}
+
+extern void
+fanout_eof(const int fd)
+{
+	int i;
+	for (i = 0; i < ngroups; i++)
+		if (groups[i].fmt)
+			ssss_eof(groups[i].fmt, fd);
+}
+
+extern long
+fanout_hold_ms(void)
+{
+	long ms = -1;
+	int i;
+	for (i = 0; i < ngroups; i++)
+		if (groups[i].fmt)
+			ms = sooner(ms, ssss_hold_ms(groups[i].fmt));
+	return ms;
+}
+
+extern void __attribute__((nonnull))
+fanout_prepare(fd_set *const w, int *const fdsn)
+{
+	int i;
+	for (i = 0; i < opts.nsinks; i++)
+		if (sinks[i].fd != -1 && !sinks[i].file && sinks[i].head < sinks[i].len) {
+			FD_SET(sinks[i].fd, w);
+			if (sinks[i].fd >= *fdsn)
+				*fdsn = sinks[i].fd + 1;
+		}
+}
+
+extern void __attribute__((nonnull))
+fanout_service(const fd_set *const w)
+{
+	int i;
+
+	for (i = 0; i < opts.nsinks; i++)
+		if (sinks[i].fd != -1 && FD_ISSET(sinks[i].fd, w))
+			drain(&sinks[i]);
+}
+
+static bool __attribute__((nonnull))
+stop_file(struct sink *const s, const uint64_t give_up_at, size_t *const left,
+		const bool quiet)
+/* See a file sink's thread off, once it's written what's queued, or given
+ * up, or it's give_up_at. Returns whether it's gone; if it's not, it's
+ * still in write(2), with the sink and its buffers, and is left to it */
+{
+	const long ms = ms_until(give_up_at);
+	struct timespec until;
+	bool gone;
+
+	clock_gettime(CLOCK_REALTIME, &until);
+	until.tv_sec += ms / 1000;
+	if ((until.tv_nsec += ms % 1000 * 1000000L) >= 1000000000L)
+		until.tv_sec++, until.tv_nsec -= 1000000000L;
+
+	pthread_mutex_lock(&s->lock);
+	s->closing = true;
+	pthread_cond_broadcast(&s->cond);
+	while ((s->head < s->len || s->writing) && !s->error
+	       && pthread_cond_timedwait(&s->cond, &s->lock, &until) == 0)
+		;
+	gone = s->error || (s->head == s->len && !s->writing);
+	*left = s->len - s->head + s->writing;
+	if (s->error && s->fd != -1 && !quiet) {
+		errno = s->error;
+		warn("%s: write(2)", s->path);
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	if (!gone) {
+		pthread_detach(s->thread);
+		return false;
+	}
+	pthread_join(s->thread, NULL);
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->cond);
+	free(s->spare);
+	return true;
+}
+
+extern void
+fanout_close(const long timeout_ms, const bool quiet)
+{
+	const uint64_t give_up_at = monotonic_ns() + (uint64_t)timeout_ms * NS_PER_MS;
+	bool stuck = false;
+	int i;
+
+	/* Whatever the formatters are holding onto, out it comes, and then
+	 * clean_up_colour's bit, which only goes to stdout */
+	for (i = 0; i < ngroups; i++) {
+		if (groups[i].fmt) {
+			ssss_flush(groups[i].fmt);
+			ssss_free(groups[i].fmt);
+		}
+		if (groups[i].flags & FLAG_COLOUR) {
+			struct iovec reset;
+			reset.iov_base = "\033[m";
+			reset.iov_len = 3;
+			write_group(&groups[i], STDOUT_FILENO, &reset, 1);
+		}
+	}
+
+	for (;;) {
+		const uint64_t now = monotonic_ns();
+		const long ms = now < give_up_at
+			? (long)((give_up_at - now) / NS_PER_MS) : 0;
+		fd_set w;
+		struct timeval tv;
+		int fdsn = 0;
+
+		FD_ZERO(&w);
+		fanout_prepare(&w, &fdsn);
+		if (!fdsn || !ms)
+			break;
+		tv.tv_sec = ms / 1000;
+		tv.tv_usec = ms % 1000 * 1000;
+		if (select(fdsn, NULL, &w, NULL, &tv) == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		fanout_service(&w);
+	}
+
+	/* The files, whose threads get what's left of the time */
+	for (i = 0; i < opts.nsinks; i++) {
+		struct sink *const s = &sinks[i];
+		size_t left = s->len - s->head;
+		const bool gone = !s->file || stop_file(s, give_up_at, &left, quiet);
+
+		if (!quiet) {
+			if (s->fd != -1 && left)
+				warnx("%s: gave up with %lu bytes unwritten",
+					s->path, (unsigned long)left);
+			if (s->dropped)
+				warnx("%s: too slow; dropped %lu bytes", s->path,
+					s->dropped);
+		}
+		if (!gone) {
+			stuck = true;
+			continue;
+		}
+		if (s->fd != -1)
+			close(s->fd);
+		free(s->buf);
+	}
+	for (i = 0; i < ngroups; i++)
+		free(groups[i].sinks);
+	free(groups);
+	if (!stuck)
+		free(sinks);
+}
@@ -0,0 +1,58 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef FANOUT_H
+#define FANOUT_H
+
+/* -o: more places for the child's output to go, each formatted its own
+ * way, in place of running ssss twice or piping a copy through sed. The
+ * sinks are grouped by how they're formatted, and each group gets one
+ * formatter, so each read(2) is formatted once per distinct format however
+ * many sinks it's going to -- and not at all for those formatted the same
+ * as our own output, which get a copy of that. Each sink has a queue of
+ * its own, written out as and when the sink will take it, so a slow one (a
+ * FIFO nobody's reading fast enough, say) holds up nothing else; past a
+ * limit, what won't fit is dropped, and counted. A file, which O_NONBLOCK
+ * does nothing for, is written by a thread of its own, for a slow disk to
+ * hold up nobody but it */
+
+#include <stddef.h>
+#include <sys/uio.h>	/* struct iovec */
+
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#else
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include "compat/bool.h"
+#include "compat/__attribute__.h"
+
+/* Opens the sinks in opts.sinks. flags are those of our own output.
+ * Returns what to give fanout_tee, for the sinks that want a copy of our
+ * own output, or NULL if none do */
+extern void *fanout_open(unsigned char flags);
+
+/* From ssss' own ssss_write_fn, with the ctx fanout_open returned */
+extern void fanout_tee(void *ctx, const struct iovec *iov, int iovcnt)
+	__attribute__((nonnull));
+
+/* As for ssss_feed, ssss_flush, ssss_eof and ssss_hold_ms, for all of the
+ * formatters at once */
+extern void fanout_feed(int fd, const char *buf, size_t n)
+	__attribute__((nonnull, __access__(read_only, 2, 3)));
+extern void fanout_flush(void);
+extern void fanout_eof(int fd);
+extern long fanout_hold_ms(void);
+
+/* For parent_listen: fanout_prepare adds the sinks with anything queued to
+ * w, raising *fdsn to the highest of them plus 1 if need be.
+ * fanout_service must be called after every select(2) */
+extern void fanout_prepare(fd_set *w, int *fdsn) __attribute__((nonnull));
+extern void fanout_service(const fd_set *w) __attribute__((nonnull));
+
+/* Write out what's left, giving up after timeout_ms */
+extern void fanout_close(long timeout_ms, bool quiet);
+
+#endif /* FANOUT_H */
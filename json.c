@@ -0,0 +1,116 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#include "config.h"
+
+#include <string.h>	/* memcpy(3) */
+
+#include "json.h"
+
+#include "compat/inline-restrict.h"
+#include "compat/__attribute__.h"
+
+/* SIMD for the poor: the bytes of an unsigned long, all at once. ONES is
+ * 0x0101...01 however long a long is */
+#define ONES	(~0UL / 255)
+#define HIGHS	(ONES * 0x80)
+
+static __inline__ unsigned long
+unsafe(const unsigned long w)
+/* Nonzero if any byte of w might need more than copying: below 0x20, `"',
+ * `\', or not ASCII. Borrows between bytes can make it say so of a word
+ * that's fine, but never the other way round, which is all we need to
+ * know whether to copy a word whole */
+{
+	return ((w - ONES * 0x20)
+		| ((w ^ ONES * '"') - ONES)
+		| ((w ^ ONES * '\\') - ONES)
+		| w) & HIGHS;
+}
+
+static __inline__ int
+safe(const unsigned char c)
+{
+	return c >= 0x20 && c < 0x80 && c != '"' && c != '\\';
+}
+
+static __inline__ size_t __attribute__((nonnull))
+utf8_len(const unsigned char *const p, const size_t n)
+/* Of the valid UTF-8 character at p, or 0 if it isn't one (including if
+ * it's cut off by n) */
+{
+	size_t len, i;
+	unsigned char lo = 0x80, hi = 0xbf; /* for p[1] */
+
+	if (p[0] < 0xc2)	return 0; /* stray continuation, or overlong */
+	else if (p[0] < 0xe0)	len = 2;
+	else if (p[0] < 0xf0) {
+		len = 3;
+		if (p[0] == 0xe0) lo = 0xa0;	/* overlong */
+		if (p[0] == 0xed) hi = 0x9f;	/* surrogates */
+	} else if (p[0] < 0xf5) {
+		len = 4;
+		if (p[0] == 0xf0) lo = 0x90;	/* overlong */
+		if (p[0] == 0xf4) hi = 0x8f;	/* past U+10FFFF */
+	} else			return 0;
+
+	if (n < len || p[1] < lo || p[1] > hi)
+		return 0;
+	for (i = 2; i < len; i++)
+		if ((p[i] & 0xc0) != 0x80)
+			return 0;
+	return len;
+}
+
+extern char * __attribute__((nonnull, returns_nonnull, __access__(read_only, 2, 3)))
+json_escape(char *__restrict__ out, const char *__restrict__ const in, size_t n)
+{
+	static const char hex[] = "0123456789abcdef";
+	const unsigned char *p = (const unsigned char *)in;
+
+	while (n) {
+		unsigned long w;
+		size_t run = 0, k;
+
+		/* A word at a time, for as long as there's nothing in them,
+		 * then a byte at a time up to whatever there is */
+		for (; n - run >= sizeof w; run += sizeof w) {
+			memcpy(&w, p + run, sizeof w);
+			if (unsafe(w))
+				break;
+		}
+		while (run < n && safe(p[run]))
+			run++;
+		memcpy(out, p, run);
+		out += run, p += run, n -= run;
+		if (!n)
+			break;
+
+		if (*p >= 0x80) {
+			if ((k = utf8_len(p, n))) {
+				memcpy(out, p, k);
+				out += k, p += k, n -= k;
+			} else {
+				memcpy(out, "\\ufffd", 6);
+				out += 6, p++, n--;
+			}
+			continue;
+		}
+
+		*out++ = '\\';
+		switch (*p) {
+		case '"':	*out++ = '"'; break;
+		case '\\':	*out++ = '\\'; break;
+		case '\b':	*out++ = 'b'; break;
+		case '\f':	*out++ = 'f'; break;
+		case '\n':	*out++ = 'n'; break;
+		case '\r':	*out++ = 'r'; break;
+		case '\t':	*out++ = 't'; break;
+		default:
+			*out++ = 'u', *out++ = '0', *out++ = '0';
+			*out++ = hex[*p >> 4], *out++ = hex[*p & 0xf];
+		}
+		p++, n--;
+	}
+
+	return out;
+}
@@ -0,0 +1,22 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef JSON_H
+#define JSON_H
+
+/* The string escaping for FLAG_JSON, for libssss.c, and bench.c */
+
+#include <stddef.h>
+
+#include "compat/__attribute__.h"
+
+/* Worst case for n bytes in: every one of them `\u001f' */
+#define JSON_ESCAPED_MAX(n) ((n) * 6)
+
+/* Writes n bytes from in to out as the inside of a JSON string: quotes,
+ * backslashes and control characters escaped, and anything that isn't
+ * valid UTF-8 replaced with U+FFFD, a byte at a time. out must have room
+ * for JSON_ESCAPED_MAX(n). Returns the end of what was written */
+extern char *json_escape(char *out, const char *in, size_t n)
+	__attribute__((nonnull, returns_nonnull, __access__(read_only, 2, 3)));
+
+#endif /* JSON_H */
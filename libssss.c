@@ -0,0 +1,616 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * The formatter behind ssss; see libssss.h. This is what was once the
+ * static guts of ssss.c, turned inside out so that nothing in here does
+ * any io of its own: ssss_feed is handed bytes, and hands back iovecs */
+#include "config.h" /* Must be before any other includes or test macros */
+
+#include <stdio.h>	/* sprintf(3), BUFSIZ */
+#include <stdlib.h>	/* malloc(3), realloc(3), free(3) */
+#include <string.h>	/* memchr(3), memcpy(3), memmove(3), memset(3) */
+
+#include <err.h>
+
+#include "libssss.h"
+#include "ansi.h"
+#include "column-in-technicolour.h"
+#include "json.h"
+#include "prefix.h"
+#include "timestamp.h"
+
+#include "compat/sdt.h"
+#include "compat/bool.h"
+#include "compat/inline-restrict.h"
+#include "compat/__attribute__.h"
+
+/* How many iovecs to batch up before calling back. Well under any
+ * IOV_MAX I've heard of (POSIX minimum is 16, but nobody's that mean) */
+#define IOV_BATCH 64
+
+/* FLAG_JSON lines longer than this are split */
+#define JSON_MAX_LINE (64 * 1024)
+
+#define CAT_IN_TECHNICOLOUR(a)\
+	void a(struct ssss *__restrict__ const s, const int fd,\
+		const char *__restrict__ buf, size_t n)
+/* A whole C++ compiler just for type polymorphism? Bitch */
+
+/* Bytes that grow */
+struct linebuf {
+	char *buf;
+	size_t len, cap;
+};
+
+/* ssss_set_grouping: the record being gathered from one stream */
+struct group {
+	struct linebuf buf;
+	size_t line;	/* where in buf the last line starts */
+	char prefix[TIMESTAMP_SIZE + 3], lprefix[TIMESTAMP_SIZE + 3];
+	size_t prefixn, lprefixn; /* mkprefix of the record, and of its last
+				   * line, from when they started */
+	uint64_t since, lsince;	/* likewise, monotonic ns */
+	uint64_t wall, lwall;	/* and realtime ns, for FLAG_JSON */
+};
+
+struct ssss {
+	ssss_write_fn *write;
+	void *ctx;
+	CAT_IN_TECHNICOLOUR((*cat));
+	struct columns *columns; /* only with FLAG_COLUMNS */
+	int width;
+	int current;	/* whose colour the output is in under FLAG_ALLINONE,
+			 * as far as we know; 0 if we don't */
+	struct ansi_state ansi[2]; /* the child's own escapes, by fd - 1 */
+	struct linebuf pending[2]; /* FLAG_JSON: unfinished lines, by fd - 1 */
+	struct linebuf out;	/* FLAG_JSON: the objects from one feed */
+	unsigned long seq;	/* FLAG_JSON: lines so far */
+	long hold_ms;		/* ssss_set_grouping; 0 if not */
+	const char *const *prefixes;
+	struct group group[2];	/* by fd - 1 */
+	const char *record;	/* the prefix of the group being let out, if
+				 * one is; its lines are to be left as one */
+	size_t recordn;
+	uint64_t record_wall;	/* and when it started */
+	unsigned long lines[2];	/* ssss_lines, by fd - 1 */
+	bool count_lines;	/* ssss_count_lines */
+	unsigned char flags;
+};
+
+struct iovbuf {
+	struct iovec iov[IOV_BATCH];
+	int n;
+};
+
+static __inline__ void __attribute__((nonnull))
+iov_flush(const struct ssss *const s, const int ofd, struct iovbuf *const b)
+{
+	if (b->n) {
+		s->write(s->ctx, ofd, b->iov, b->n);
+		b->n = 0;
+	}
+}
+
+static __inline__ void __attribute__((nonnull))
+iov_push(const struct ssss *const s, const int ofd, struct iovbuf *const b,
+	const char *const p, const size_t n)
+{
+	if (b->n == IOV_BATCH)
+		iov_flush(s, ofd, b);
+	b->iov[b->n].iov_base = (char *)p; /* writev(2) won't write to it */
+	b->iov[b->n].iov_len = n;
+	b->n++;
+}
+
+static __inline__ const char *
+colour_of(const int fd)
+{
+	return fd == 1 ? "\033[32m" : "\033[31m";
+}
+
+static __inline__ void __attribute__((nonnull))
+start_colour(struct ssss *const s, const int fd, const int ofd, struct iovbuf *const b)
+/* Switch to fd's colour, unless -1 means we know it's already there, or
+ * the last read left off in the middle of one of the child's escapes */
+{
+	if (s->flags & FLAG_COLOUR
+	    && !(s->flags & FLAG_ALLINONE && s->current == fd)
+	    && !ansi_pending(&s->ansi[fd - 1]))
+	{
+		iov_push(s, ofd, b, colour_of(fd), 5); /* strlen(colour) */
+		s->current = fd;
+	}
+}
+
+static void __attribute__((nonnull, __access__(read_only, 5, 6)))
+push_coloured(struct ssss *__restrict__ const s, const int fd, const int ofd,
+	struct iovbuf *__restrict__ const b, const char *__restrict__ p, size_t n)
+/* iov_push for the child's bytes: if it resets the colour with escapes
+ * of its own, put ours back straight after */
+{
+	if (~s->flags & FLAG_COLOUR) {
+		iov_push(s, ofd, b, p, n);
+		return;
+	}
+
+	while (n) {
+		int fg;
+		const size_t k = ansi_scan(&s->ansi[fd - 1], p, n, &fg);
+
+		iov_push(s, ofd, b, p, k);
+		switch (fg) {
+		case ANSI_FG_DEFAULT:
+			iov_push(s, ofd, b, colour_of(fd), 5);
+			s->current = fd;
+			break;
+		case ANSI_FG_SET:
+			s->current = 0;
+		}
+		p += k, n -= k;
+	}
+}
+
+static __inline__ void __attribute__((nonnull, __access__(read_only, 4, 5)))
+prepend_lines (
+	struct ssss *__restrict__ const s,
+	const int fd,
+	struct iovbuf *__restrict__ const b,
+	const char *__restrict__ unprinted __attribute__((nonstring)),
+	/* I think  ^ this is probably maybe quite possibly OK */
+	size_t n_unprinted
+) {
+	const int ofd = (s->flags & FLAG_ALLINONE) ? 1 : fd;
+	const char *__restrict__ newline_ptr __attribute__((nonstring));
+	/* This one ^ also */
+	char prefixstr[TIMESTAMP_SIZE + 3] __attribute__((nonstring));
+	const char *prefix = prefixstr;
+	size_t prefixn;
+
+	/* A group from ssss_set_grouping: one prefix, taken when it started,
+	 * for the lot */
+	if (s->record) {
+		prefix = s->record, prefixn = s->recordn;
+		goto rest;
+	}
+
+	prefixn = mkprefix(s->flags, fd, prefixstr);
+	/* Calls gettimeofday(2), ^ so must be called *after* read(2),
+	 * else it delays read(2) too long and fucks up the timing */
+
+	/* Look for a newline anywhere but the last char */
+	while ((newline_ptr = memchr(unprinted, '\n', n_unprinted - 1))) {
+		iov_push(s, ofd, b, prefix, prefixn);
+		newline_ptr++;
+		push_coloured(s, fd, ofd, b, unprinted, newline_ptr - unprinted);
+		n_unprinted -= newline_ptr - unprinted;
+		unprinted = newline_ptr;
+		s->lines[fd - 1]++;
+	}
+	s->lines[fd - 1] += unprinted[n_unprinted - 1] == '\n';
+
+	/* Once any embedded newlines have been exhausted, print the rest */
+rest:	iov_push(s, ofd, b, prefix, prefixn);
+	push_coloured(s, fd, ofd, b, unprinted, n_unprinted);
+
+	/* prefixstr is about to go out of scope */
+	iov_flush(s, ofd, b);
+}
+
+static
+CAT_IN_TECHNICOLOUR(cat_in_technicolour_timestamps)
+/* -t and/or -p: a prefix for every line */
+{
+	struct iovbuf b;
+	b.n = 0;
+
+	start_colour(s, fd, (s->flags & FLAG_ALLINONE) ? 1 : fd, &b);
+	prepend_lines(s, fd, &b, buf, n);
+}
+
+static
+CAT_IN_TECHNICOLOUR(cat_in_technicolour) /* buffalo buffalo */
+/* Neither -t nor -p: colour, if anything, then the bytes as they came,
+ * all in one writev(2)'s worth unless the child has escapes of its own */
+{
+	const int ofd = (s->flags & FLAG_ALLINONE) ? 1 : fd;
+	struct iovbuf b;
+	b.n = 0;
+
+	start_colour(s, fd, ofd, &b);
+	push_coloured(s, fd, ofd, &b, buf, n);
+	iov_flush(s, ofd, &b);
+}
+
+static void __attribute__((nonnull))
+linebuf_reserve(struct linebuf *const b, const size_t n)
+/* Make room for n more bytes */
+{
+	if (b->cap - b->len < n) {
+		while (b->cap - b->len < n)
+			b->cap = b->cap ? b->cap * 2 : BUFSIZ;
+		if (!(b->buf = realloc(b->buf, b->cap)))
+			err(-1, NULL);
+	}
+}
+
+static __inline__ void __attribute__((nonnull, __access__(read_only, 2, 3)))
+linebuf_append(struct linebuf *const b, const char *const p, const size_t n)
+{
+	linebuf_reserve(b, n);
+	memcpy(b->buf + b->len, p, n);
+	b->len += n;
+}
+
+static size_t __attribute__((nonnull, __access__(write_only, 1)))
+json_head(char head[64], const int fd, const uint64_t ns)
+/* Everything in an object up to the seq, which is the same for every line
+ * from one read(2) */
+{
+	return sprintf(head, "{\"stream\":%d,\"ts\":%lu.%06lu,\"seq\":", fd,
+		(unsigned long)(ns / 1000000000), (unsigned long)(ns % 1000000000 / 1000));
+}
+
+static __inline__ void __attribute__((nonnull, __access__(read_only, 2, 3), __access__(read_only, 4, 5)))
+json_line(struct ssss *__restrict__ const s, const char *__restrict__ const head,
+	const size_t headn, const char *__restrict__ const p, const size_t n)
+/* One object, onto s->out */
+{
+	char digits[3 * sizeof s->seq], *o;
+	unsigned long seq = s->seq++;
+	size_t i = sizeof digits;
+
+	do
+		digits[--i] = '0' + seq % 10;
+	while (seq /= 10);
+
+	linebuf_reserve(&s->out, headn + sizeof digits + sizeof ",\"line\":\"\"}\n"
+		+ JSON_ESCAPED_MAX(n));
+	o = s->out.buf + s->out.len;
+	memcpy(o, head, headn), o += headn;
+	memcpy(o, digits + i, sizeof digits - i), o += sizeof digits - i;
+	memcpy(o, ",\"line\":\"", 9), o += 9;
+	o = json_escape(o, p, n);
+	memcpy(o, "\"}\n", 3), o += 3;
+	s->out.len = o - s->out.buf;
+}
+
+static __inline__ void __attribute__((nonnull))
+json_write(struct ssss *const s, const int fd)
+/* Everything on s->out, in one go */
+{
+	if (s->out.len) {
+		struct iovec iov;
+		iov.iov_base = s->out.buf;
+		iov.iov_len = s->out.len;
+		s->write(s->ctx, (s->flags & FLAG_ALLINONE) ? 1 : fd, &iov, 1);
+		s->out.len = 0;
+	}
+}
+
+static size_t __attribute__((nonnull, __access__(read_only, 4, 5)))
+json_split(struct ssss *__restrict__ const s, const char *__restrict__ const head,
+	const size_t headn, const char *__restrict__ p, size_t n, const bool whole)
+/* p as objects of at most JSON_MAX_LINE bytes of line each, not cut in the
+ * middle of a UTF-8 character if it can help it. If whole, that's all of
+ * the line, and out it all goes; if not, there's more of it to come, so
+ * the last of it, short of JSON_MAX_LINE, waits, and how much that is is
+ * returned */
+{
+	while (n > JSON_MAX_LINE || (!whole && n == JSON_MAX_LINE)) {
+		size_t cut = JSON_MAX_LINE;
+		if (cut < n)
+			while (cut > JSON_MAX_LINE - 3 && (p[cut] & 0xc0) == 0x80)
+				cut--;
+		else {
+			/* Nothing after the cut to look at yet: the last
+			 * character's finished if there's as much of it as
+			 * its first byte says, else it waits with the rest */
+			size_t lead = cut - 1;
+			while (lead > JSON_MAX_LINE - 4 && (p[lead] & 0xc0) == 0x80)
+				lead--;
+			if ((p[lead] & 0xe0) == 0xc0 ? cut - lead < 2
+			    : (p[lead] & 0xf0) == 0xe0 ? cut - lead < 3
+			    : (p[lead] & 0xf8) == 0xf0 ? cut - lead < 4 : false)
+				cut = lead;
+		}
+		json_line(s, head, headn, p, cut);
+		p += cut, n -= cut;
+	}
+	if (!whole)
+		return n;
+	json_line(s, head, headn, p, n);
+	return 0;
+}
+
+static
+CAT_IN_TECHNICOLOUR(cat_in_json)
+/* -j: the same splitting as prepend_lines, but a line that isn't finished
+ * waits in s->pending for the rest of it */
+{
+	struct linebuf *const pending = &s->pending[fd - 1];
+	const char *newline_ptr;
+	char head[64];
+	const size_t headn = json_head(head, fd, s->record ? s->record_wall : realtime_ns());
+
+	/* A whole group from ssss_set_grouping is one line, newlines and all */
+	if (s->record && !pending->len && buf[n - 1] == '\n') {
+		json_split(s, head, headn, buf, n - 1, true);
+		json_write(s, fd);
+		return;
+	}
+
+	while ((newline_ptr = memchr(buf, '\n', n))) {
+		const size_t k = newline_ptr - buf;
+		s->lines[fd - 1] += !s->record;
+		if (pending->len) {
+			linebuf_append(pending, buf, k);
+			json_split(s, head, headn, pending->buf, pending->len, true);
+			pending->len = 0;
+		} else
+			json_split(s, head, headn, buf, k, true);
+		buf += k + 1, n -= k + 1;
+	}
+
+	if (n) {
+		size_t left;
+		linebuf_append(pending, buf, n);
+		left = json_split(s, head, headn, pending->buf, pending->len, false);
+		memmove(pending->buf, pending->buf + pending->len - left, left);
+		pending->len = left;
+	}
+
+	json_write(s, fd);
+}
+
+static __inline__ bool __attribute__((nonnull, __access__(read_only, 2, 3)))
+continues(const struct ssss *__restrict__ const s, const char *__restrict__ const line,
+	const size_t n)
+/* Whether line belongs with the one before: starts with whitespace, or one
+ * of s->prefixes */
+{
+	const char *const *p;
+
+	if (n && (*line == ' ' || *line == '\t'))
+		return true;
+	if (s->prefixes)
+		for (p = s->prefixes; *p; p++) {
+			const size_t k = strlen(*p);
+			if (k <= n && memcmp(line, *p, k) == 0)
+				return true;
+		}
+	return false;
+}
+
+static __inline__ void __attribute__((nonnull))
+group_next(struct group *const g)
+/* The last line is the start of the group now */
+{
+	memcpy(g->prefix, g->lprefix, g->lprefixn);
+	g->prefixn = g->lprefixn;
+	g->since = g->lsince;
+	g->wall = g->lwall;
+}
+
+static void __attribute__((nonnull))
+group_emit(struct ssss *const s, const int fd, const size_t n)
+/* Let out the first n bytes of fd's group, as one */
+{
+	struct group *const g = &s->group[fd - 1];
+
+	s->record = g->prefix;
+	s->recordn = g->prefixn;
+	s->record_wall = g->wall;
+	s->cat(s, fd, g->buf.buf, n);
+	s->record = NULL;
+
+	memmove(g->buf.buf, g->buf.buf + n, g->buf.len -= n);
+	g->line = g->line > n ? g->line - n : 0;
+}
+
+static void __attribute__((nonnull, __access__(read_only, 3, 4)))
+group_feed(struct ssss *__restrict__ const s, const int fd,
+	const char *__restrict__ buf, size_t n)
+/* Gather lines into the group until one that doesn't continue it; then
+ * out goes the group, and that line starts the next */
+{
+	struct group *const g = &s->group[fd - 1];
+	char prefix[TIMESTAMP_SIZE + 3];
+	const size_t prefixn = mkprefix(s->flags, fd, prefix);
+	const uint64_t now = monotonic_ns(),
+		wall = s->flags & FLAG_JSON ? realtime_ns() : 0;
+
+	while (n) {
+		const char *const newline_ptr = memchr(buf, '\n', n);
+		const size_t k = newline_ptr ? (size_t)(newline_ptr - buf) + 1 : n;
+
+		/* The start of a line: note when, in case it starts a group */
+		if (g->line == g->buf.len) {
+			memcpy(g->lprefix, prefix, prefixn);
+			g->lprefixn = prefixn;
+			g->lsince = now;
+			g->lwall = wall;
+			if (!g->buf.len)
+				group_next(g);
+		}
+
+		linebuf_append(&g->buf, buf, k);
+		buf += k, n -= k;
+
+		if (!newline_ptr)
+			break;
+		s->lines[fd - 1]++;
+
+		/* A whole line; if it's the first of a new group, send the
+		 * last one on its way */
+		if (g->line && !continues(s, g->buf.buf + g->line, g->buf.len - g->line)) {
+			group_emit(s, fd, g->line);
+			group_next(g);
+		}
+		g->line = g->buf.len;
+	}
+}
+
+static
+CAT_IN_TECHNICOLOUR(cat_in_columns)
+/* -S: nothing comes out until ssss_flush, so both sides can be paired */
+{
+	columns_feed(s->columns, fd, buf, n);
+}
+
+extern struct ssss * __attribute__((nonnull(2), malloc, returns_nonnull))
+ssss_new(const unsigned char flags, ssss_write_fn *const write, void *const ctx)
+{
+	struct ssss *const s = malloc(sizeof *s);
+	if (!s)
+		err(-1, NULL);
+
+	s->write = write;
+	s->ctx = ctx;
+	s->flags = flags;
+	s->width = 80;
+	s->current = 0;
+	s->columns = NULL;
+	s->seq = 0;
+	memset(s->ansi, 0, sizeof s->ansi);
+	memset(s->pending, 0, sizeof s->pending);
+	memset(&s->out, 0, sizeof s->out);
+	s->hold_ms = 0;
+	s->prefixes = NULL;
+	memset(s->group, 0, sizeof s->group);
+	s->record = NULL;
+	s->lines[0] = s->lines[1] = 0;
+	s->count_lines = false;
+
+	if (flags & FLAG_JSON)
+		s->cat = cat_in_json;
+	else if (flags & FLAG_COLUMNS) {
+		s->cat = cat_in_columns;
+		s->columns = columns_new();
+	} else if (flags & (FLAG_TIMESTAMPS | FLAG_PREFIX))
+		s->cat = cat_in_technicolour_timestamps;
+	else
+		s->cat = cat_in_technicolour;
+
+	return s;
+}
+
+extern void
+ssss_free(struct ssss *const s)
+{
+	if (s) {
+		if (s->columns)
+			columns_free(s->columns);
+		free(s->pending[0].buf);
+		free(s->pending[1].buf);
+		free(s->out.buf);
+		free(s->group[0].buf.buf);
+		free(s->group[1].buf.buf);
+		free(s);
+	}
+}
+
+extern void __attribute__((nonnull, __access__(read_only, 3, 4)))
+ssss_feed(struct ssss *const s, const int fd, const char *const buf, const size_t n)
+{
+	if (n) {
+		PROBE2(format__start, fd, n);
+		/* The only ones that don't look for newlines themselves */
+		if (s->count_lines && !s->hold_ms
+		    && (s->cat == cat_in_technicolour || s->cat == cat_in_columns)) {
+			const char *p = buf, *nl;
+			while ((nl = memchr(p, '\n', n - (p - buf))))
+				s->lines[fd - 1]++, p = nl + 1;
+		}
+		if (s->hold_ms)
+			group_feed(s, fd, buf, n);
+		else
+			s->cat(s, fd, buf, n);
+		PROBE2(format__end, fd, n);
+	}
+}
+
+extern void __attribute__((nonnull))
+ssss_flush(struct ssss *const s)
+{
+	if (s->hold_ms) {
+		const uint64_t now = monotonic_ns();
+		int i;
+		for (i = 0; i < 2; i++) {
+			struct group *const g = &s->group[i];
+			if (!g->buf.len
+			    || now < g->since + (uint64_t)s->hold_ms * NS_PER_MS)
+				continue;
+
+			/* Held long enough. An unfinished line on the end
+			 * (a prompt, say) is one of its own */
+			if (g->line && g->line < g->buf.len) {
+				group_emit(s, i + 1, g->line);
+				group_next(g);
+			}
+			group_emit(s, i + 1, g->buf.len);
+		}
+	}
+
+	if (s->columns)
+		print_columns(s->columns, s->width, s->flags, s->write, s->ctx);
+}
+
+extern void __attribute__((nonnull))
+ssss_eof(struct ssss *const s, const int fd)
+{
+	struct linebuf *const pending = &s->pending[fd - 1];
+
+	if (s->group[fd - 1].buf.len)
+		group_emit(s, fd, s->group[fd - 1].buf.len);
+
+	if (pending->len) {
+		char head[64];
+		const size_t headn = json_head(head, fd, realtime_ns());
+		json_line(s, head, headn, pending->buf, pending->len);
+		pending->len = 0;
+		json_write(s, fd);
+	}
+}
+
+extern void __attribute__((nonnull(1)))
+ssss_set_grouping(struct ssss *const s, const long hold_ms,
+		const char *const *const prefixes)
+{
+	if (!s->columns) {
+		s->hold_ms = hold_ms;
+		s->prefixes = prefixes;
+	}
+}
+
+extern void __attribute__((nonnull))
+ssss_count_lines(struct ssss *const s)
+{
+	s->count_lines = true;
+}
+
+extern unsigned long __attribute__((nonnull))
+ssss_lines(const struct ssss *const s, const int fd)
+{
+	return s->lines[fd - 1];
+}
+
+extern long __attribute__((nonnull))
+ssss_hold_ms(const struct ssss *const s)
+{
+	const uint64_t now = monotonic_ns();
+	long ms = -1;
+	int i;
+
+	if (s->hold_ms)
+		for (i = 0; i < 2; i++)
+			if (s->group[i].buf.len)
+				ms = sooner(ms, ms_between(now, s->group[i].since
+					+ (uint64_t)s->hold_ms * NS_PER_MS));
+	return ms;
+}
+
+extern void __attribute__((nonnull))
+ssss_set_width(struct ssss *const s, const int width)
+{
+	s->width = width;
+}
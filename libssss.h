@@ -0,0 +1,103 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef LIBSSSS_H
+#define LIBSSSS_H
+
+/* libssss: everything ssss does to its child's output, minus the child.
+ * Push-style: make a formatter with ssss_new, feed it whatever bytes come
+ * out of each of the child's streams as and when they turn up, and it
+ * calls back with the formatted output as iovecs, ready for writev(2).
+ * It never reads, writes, forks or sets signal handlers of its own; the
+ * ssss executable is just one client of it.
+ *
+ * Stream ids are file descriptor numbers, as they were to the child: 1 for
+ * stdout and 2 for stderr, here and in the callback's ofd. On allocation
+ * failure, like the rest of ssss, this calls err(3) */
+
+#include <stddef.h>	/* size_t */
+#include <sys/uio.h>	/* struct iovec */
+
+#include "compat/__attribute__.h"
+
+/* Flag constants -- used to be macros, but it's useful to have them typed
+ * just in case. FLAG_VERBOSE and FLAG_QUIET are the ssss executable's
+ * business; the formatter ignores them.
+ *
+ * FLAG_JSON makes each line a JSON object of its own line, as in
+ *
+ *	{"stream":2,"ts":1700000000.123456,"seq":41,"line":"oh no"}
+ *
+ * where ts is the wall-clock time of the read(2) that finished the line,
+ * and seq counts lines from 0 across both streams. Lines are held until
+ * they're finished (or until ssss_eof), and those longer than 64 KiB are
+ * split. It overrides every other flag but FLAG_ALLINONE */
+#if __STDC_VERSION__ >= 202300L
+enum : unsigned char {
+#else
+static const unsigned char
+#endif /* C23 */
+	FLAG_ALLINONE	= 1 << 0,
+	FLAG_TIMESTAMPS	= 1 << 1,
+	FLAG_COLOUR	= 1 << 2,
+	FLAG_PREFIX	= 1 << 3,
+	FLAG_VERBOSE	= 1 << 4,
+	FLAG_QUIET	= 1 << 5,
+	FLAG_COLUMNS	= 1 << 6,
+	FLAG_JSON	= 1 << 7
+#if __STDC_VERSION__ >= 202300L
+}
+#endif /* C23 */
+	;
+
+/* Called with formatted output destined for ofd (always 1 under
+ * FLAG_ALLINONE or FLAG_COLUMNS). iov may point into the buffer given to
+ * ssss_feed and into the formatter itself, so is only good until the
+ * callback returns */
+typedef void ssss_write_fn(void *ctx, int ofd, const struct iovec *iov, int iovcnt);
+
+struct ssss;
+
+extern struct ssss *ssss_new(unsigned char flags, ssss_write_fn *write, void *ctx)
+	__attribute__((nonnull(2), malloc, returns_nonnull));
+extern void ssss_free(struct ssss *s);
+
+/* Format n bytes read from stream fd. Stick to one feed per read(2) if
+ * you can: timestamps are taken per feed */
+extern void ssss_feed(struct ssss *s, int fd, const char *buf, size_t n)
+	__attribute__((nonnull, __access__(read_only, 3, 4)));
+
+/* Call after each round of feeds (eg. once per select(2) wakeup), to
+ * output anything held back: with FLAG_COLUMNS, this is when stdout and
+ * stderr are paired up into rows */
+extern void ssss_flush(struct ssss *s) __attribute__((nonnull));
+
+/* Stream fd has finished: output anything still held back from it, which
+ * under FLAG_JSON is a last line without a newline */
+extern void ssss_eof(struct ssss *s, int fd) __attribute__((nonnull));
+
+/* Gather each line together with those after it that continue it -- that
+ * start with a space or a tab, or with one of prefixes (NULL-terminated,
+ * and must outlive s; may be NULL) -- and output them as one, with one
+ * prefix, from when the first of them turned up. So a stack trace comes
+ * out in one piece, and nothing from the other stream can get in the
+ * middle of it. The catch is that a group can only go once the line
+ * after it starts, so it's held for up to hold_ms (0 for no grouping)
+ * first: ssss_flush lets out any that have been held that long, and
+ * ssss_hold_ms says how many ms until there will be, or -1 if there's
+ * none held. Ignored with FLAG_COLUMNS */
+extern void ssss_set_grouping(struct ssss *s, long hold_ms, const char *const *prefixes)
+	__attribute__((nonnull(1)));
+extern long ssss_hold_ms(const struct ssss *s) __attribute__((nonnull));
+
+/* For FLAG_COLUMNS: total width of the output in columns, which is split
+ * between the two streams. Default 80 */
+extern void ssss_set_width(struct ssss *s, int width) __attribute__((nonnull));
+
+/* Newlines fed so far on stream fd. They're counted as the formatter
+ * finds them, which it does anyway for all but plain output and
+ * FLAG_COLUMNS; for those it only looks, a memchr(3) pass a feed, after
+ * ssss_count_lines */
+extern void ssss_count_lines(struct ssss *s) __attribute__((nonnull));
+extern unsigned long ssss_lines(const struct ssss *s, int fd) __attribute__((nonnull));
+
+#endif /* LIBSSSS_H */
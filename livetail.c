@@ -0,0 +1,299 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#include "config.h"
+
+#if _POSIX_C_SOURCE < 199309L
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <errno.h>
+#include <signal.h>	/* kill(2), sigaction(2) */
+#include <stdio.h>	/* sprintf(3) */
+#include <stdlib.h>	/* malloc(3), free(3) */
+#include <string.h>	/* memcpy(3), memcmp(3), strlen(3) */
+#include <time.h>	/* nanosleep(2) */
+
+#include <err.h>
+#include <fcntl.h>
+#include <sys/mman.h>	/* shm_open(3), mmap(2) */
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>	/* writev(2) */
+#include <unistd.h>
+
+#include "libssss.h"
+#include "livetail.h"
+#include "winsize.h"
+
+#include "compat/bool.h"
+#include "compat/inline-restrict.h"
+#include "compat/__attribute__.h"
+
+/* The writer's stores to the ring against its stores to head and tail,
+ * and the reader's loads likewise. C89 knows nothing of the sort, so it's
+ * GCC's full barrier, or else hope */
+#ifdef __GNUC__
+# define BARRIER() __sync_synchronize()
+#else
+# define BARRIER() ((void)0)
+#endif
+
+#define MAGIC	"SSSSTAIL"
+#define RING	(1UL << 20)	/* bytes of records */
+#define ALIGN	16		/* of records in the ring */
+#define REC	16		/* bytes of struct rec, padded to ALIGN */
+#define MAXREC	(RING / 8)	/* longest feed in one record */
+#define DATA	64		/* where the ring starts in the mapping */
+#define POLL_MS	10		/* how often a reader looks, when there's nothing */
+
+/* At the top of the mapping. Positions count bytes ever written, and
+ * wrap round unsigned long, which is a multiple of RING, so pos % RING is
+ * where they are in the ring either way; [tail, head) is what's in it.
+ * Native-endian, native-sized: it's only for this machine */
+struct ring {
+	char magic[8];		/* written last, once the rest is ready */
+	unsigned long size;
+	long pid;		/* of the ssss writing it */
+	volatile unsigned long head, tail;
+	volatile int closed;
+};
+
+/* Then each record is one of these, then len bytes, padded to ALIGN. fd 0
+ * is padding to the end of the ring, where the next record wouldn't fit */
+struct rec {
+	unsigned long len;
+	int fd;
+};
+
+static __inline__ unsigned long
+span(const unsigned long len)
+/* Of a record, all in */
+{
+	return REC + ((len + ALIGN - 1) & ~(unsigned long)(ALIGN - 1));
+}
+
+static char * __attribute__((nonnull, malloc, returns_nonnull))
+shm_name(const char *const name)
+{
+	char *const s = malloc(strlen(name) + sizeof "/ssss-");
+	if (!s)
+		err(-1, NULL);
+	sprintf(s, "/ssss-%s", name);
+	return s;
+}
+
+/* The writer's end */
+static struct {
+	struct ring *r;
+	char *data, *name;
+	unsigned long head, tail;
+} w;
+
+extern void __attribute__((nonnull))
+livetail_open(const char *const name)
+{
+	int fd;
+
+	w.name = shm_name(name);
+	/* Anything left by an ssss that didn't get to clean up is ours now;
+	 * the truncation to 0 first clears it */
+	if ((fd = shm_open(w.name, O_RDWR | O_CREAT, 0600)) == -1
+	    || ftruncate(fd, 0) || ftruncate(fd, DATA + RING))
+		err(-1, "-T %s", name);
+	w.r = mmap(NULL, DATA + RING, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (w.r == MAP_FAILED)
+		err(-1, "-T %s", name);
+	close(fd);
+
+	w.data = (char *)w.r + DATA;
+	w.r->size = RING;
+	w.r->pid = getpid();
+	BARRIER();
+	memcpy(w.r->magic, MAGIC, sizeof w.r->magic);
+}
+
+static void
+make_room(const unsigned long need)
+/* Forget the oldest records until there's need bytes free */
+{
+	while (w.head + need - w.tail > RING) {
+		struct rec rec;
+		memcpy(&rec, w.data + w.tail % RING, sizeof rec);
+		w.tail += span(rec.len);
+	}
+}
+
+static void __attribute__((nonnull))
+put(const int fd, const char *const buf, const unsigned long n)
+{
+	struct rec rec;
+	unsigned long at = w.head % RING;
+
+	if (RING - at < span(n)) {
+		make_room(RING - at);
+		w.r->tail = w.tail;
+		BARRIER();
+		rec.len = RING - at - REC, rec.fd = 0;
+		memcpy(w.data + at, &rec, sizeof rec);
+		w.head += RING - at;
+		at = 0;
+	}
+
+	/* tail first, so that anyone reading what's about to be written
+	 * over knows by the time they're done that it was */
+	make_room(span(n));
+	w.r->tail = w.tail;
+	BARRIER();
+	rec.len = n, rec.fd = fd;
+	memcpy(w.data + at, &rec, sizeof rec);
+	memcpy(w.data + at + REC, buf, n);
+	BARRIER();
+	w.r->head = w.head += span(n);
+}
+
+extern void __attribute__((nonnull, __access__(read_only, 2, 3)))
+livetail_feed(const int fd, const char *buf, size_t n)
+{
+	while (n) {
+		const size_t k = n < MAXREC ? n : MAXREC;
+		put(fd, buf, k);
+		buf += k, n -= k;
+	}
+}
+
+extern void
+livetail_close(void)
+{
+	w.r->closed = 1;
+	/* Anyone attached has it mapped, and can carry on to the end */
+	if (shm_unlink(w.name))
+		warn("-T %s", w.name);
+	munmap(w.r, DATA + RING);
+	free(w.name);
+}
+
+/* The reader's end */
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void
+on_sigint(int sig __attribute__((unused)))
+{
+	interrupted = 1;
+}
+
+static void
+write_out(void *ctx __attribute__((unused)), const int ofd,
+		const struct iovec *const iov, const int iovcnt)
+{
+	const ssize_t n = writev(ofd, iov, iovcnt);
+	(void)n;
+}
+
+static __inline__ bool
+gone(const struct ring *const r)
+/* Whether there's no more coming */
+{
+	return r->closed || (kill(r->pid, 0) && errno == ESRCH);
+}
+
+extern int __attribute__((nonnull))
+livetail_attach(const char *const name, const unsigned char flags)
+{
+	static char buf[MAXREC];
+	const struct timespec poll = { 0, POLL_MS * 1000000L };
+	char *const path = shm_name(name);
+	const struct ring *r;
+	const char *data;
+	struct ssss *fmt;
+	struct sigaction sa;
+	unsigned long pos, lost = 0;
+	int fd;
+
+	if ((fd = shm_open(path, O_RDONLY, 0)) == -1)
+		err(-1, "--attach %s", name);
+	r = mmap(NULL, DATA + RING, PROT_READ, MAP_SHARED, fd, 0);
+	if (r == MAP_FAILED)
+		err(-1, "--attach %s", name);
+	close(fd);
+	if (memcmp(r->magic, MAGIC, sizeof r->magic) || r->size != RING)
+		errx(-1, "--attach %s: not an ssss -T (or not from this ssss)", name);
+	BARRIER();
+	data = (const char *)r + DATA;
+
+	/* So that ^C leaves the terminal in its right colours */
+	sa.sa_handler = on_sigint;
+	sa.sa_flags = 0;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+
+	fmt = ssss_new(flags, write_out, NULL);
+	pos = r->tail;
+
+	while (!interrupted) {
+		const unsigned long head = r->head;
+		struct rec rec;
+
+		BARRIER();
+		if (pos == head) {
+			/* It may have written the last of it and closed
+			 * since head was read; if so, that's still to come */
+			if (gone(r)) {
+				BARRIER();
+				if (pos == r->head)
+					break;
+				continue;
+			}
+			if (flags & FLAG_COLUMNS) {
+				terminal_resized();
+				ssss_set_width(fmt, terminal_width());
+			}
+			ssss_flush(fmt);
+			nanosleep(&poll, NULL);
+			continue;
+		}
+
+		{
+			const unsigned long tail = r->tail;
+			if ((long)(pos - tail) < 0) {
+				lost += tail - pos;
+				pos = tail;
+				continue;
+			}
+		}
+
+		/* Copy, then check it wasn't being written over while we
+		 * were at it; if it was, round again */
+		memcpy(&rec, data + pos % RING, sizeof rec);
+		BARRIER();
+		if ((long)(pos - r->tail) < 0)
+			continue;
+		if (rec.fd && rec.len <= MAXREC) {
+			memcpy(buf, data + pos % RING + REC, rec.len);
+			BARRIER();
+			if ((long)(pos - r->tail) < 0)
+				continue;
+		}
+
+		if (lost) {
+			ssss_flush(fmt);
+			warnx("fell behind; missed %lu bytes", lost);
+			lost = 0;
+		}
+		if ((rec.fd == 1 || rec.fd == 2) && rec.len <= MAXREC)
+			ssss_feed(fmt, rec.fd, buf, rec.len);
+		pos += span(rec.len);
+	}
+
+	ssss_eof(fmt, STDOUT_FILENO);
+	ssss_eof(fmt, STDERR_FILENO);
+	ssss_flush(fmt);
+	ssss_free(fmt);
+	if (flags & FLAG_COLOUR)
+		write(STDOUT_FILENO, "\033[m", 3);
+
+	munmap((void *)r, DATA + RING);
+	free(path);
+	return 0;
+}
@@ -0,0 +1,35 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef LIVETAIL_H
+#define LIVETAIL_H
+
+/* -T NAME: publish the child's output, as it was read, in a ring buffer in
+ * POSIX shared memory (/ssss-NAME), for `ssss --attach NAME' to watch from
+ * any other terminal, formatted however it likes. In place of -l and
+ * `tail -f', without the disk.
+ *
+ * There's one writer and no locks: the writer never waits for anyone. A
+ * reader that falls a whole ring behind skips to the oldest record that's
+ * still there, and says how much it missed. Readers start from the oldest
+ * record there is, so get a bit of what came before; -t's times are when
+ * they got to the reader, though, not when PROG wrote them.
+ *
+ * shm_open(3) is in libc proper as of glibc 2.34; before that, make
+ * LDLIBS=-lrt */
+
+#include <stddef.h>
+
+#include "compat/__attribute__.h"
+
+/* For ssss -T */
+extern void livetail_open(const char *name) __attribute__((nonnull));
+extern void livetail_feed(int fd, const char *buf, size_t n)
+	__attribute__((nonnull, __access__(read_only, 2, 3)));
+extern void livetail_close(void);
+
+/* For ssss --attach: watch until the ssss on the other end is done, and
+ * return what ssss should */
+extern int livetail_attach(const char *name, unsigned char flags)
+	__attribute__((nonnull));
+
+#endif /* LIVETAIL_H */
@@ -0,0 +1,369 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>	/* snprintf(3), rename(2) */
+#include <stdlib.h>	/* malloc(3), free(3) */
+#include <string.h>	/* memcpy(3), strlen(3) */
+
+#include <err.h>
+#include <fcntl.h>	/* open(2), fcntl(2), fallocate(2) */
+#include <sys/stat.h>	/* fstat(2) */
+#include <sys/types.h>
+#include <unistd.h>	/* write(2), fdatasync(2), ftruncate(2) */
+
+#include "libssss.h"
+#include "logfile.h"
+#include "lzwriter.h"
+#include "process_cmdline.h"
+#include "timestamp.h"
+
+#include "compat/bool.h"
+#include "compat/inline-restrict.h"
+#include "compat/__attribute__.h"
+
+#define BLOCK		4096		/* what we try to write in multiples of */
+#define BUF		(16 * BLOCK)	/* and how much we hold on to for it */
+#define PREALLOC	(4L << 20)	/* fallocate(2) this much at a time */
+#define SYNC_MS		1000		/* defaults for -L */
+#define KEEP		5
+
+static struct logfile {
+	const char *path;
+	int fd;		/* -1 if closed, after an error */
+	char *buf;	/* BUF bytes, not yet written */
+	size_t len;
+	off_t size;	/* bytes written to the file */
+	off_t allocated; /* and how far it's been fallocate(2)d */
+	uint64_t opened; /* monotonic ns, for age= */
+	uint64_t due;	/* when buf next gets written out and synced */
+	bool dirty;	/* written to since the last fdatasync(2) */
+	bool bol;	/* the last thing written ended a line */
+	bool rotate_due; /* as soon as it does */
+	struct lzwriter *z; /* -L compress: it does the writing, not us */
+} logs[2], *byfd[2]; /* byfd[0] and [1] may be the same, if combined */
+
+static int nlogs;
+static struct ssss *fmt;
+
+static void __attribute__((nonnull))
+give_up(struct logfile *const l, const char *const what)
+/* Losing the log isn't worth losing the child's output over */
+{
+	warn("%s: %s", l->path, what);
+	if (l->z) {
+		lzwriter_close(l->z);
+		l->z = NULL;
+	}
+	if (l->fd != -1)
+		close(l->fd);
+	l->fd = -1;
+	l->len = 0;
+}
+
+static void __attribute__((nonnull))
+open_log(struct logfile *const l, const bool first)
+/* If it's not the first time, it's after rotate, with the child well under
+ * way, and then it's give_up rather than err(3) */
+{
+	struct stat st;
+
+	/* Read as well, compressed, for lzwriter_open to find the last
+	 * block */
+	l->fd = open(l->path, (opts.log.compress ? O_RDWR : O_WRONLY) | O_CREAT | O_APPEND, 0666);
+	if (l->fd == -1 || fstat(l->fd, &st)) {
+		if (first)
+			err(-1, "%s", l->path);
+		give_up(l, "open(2)");
+		return;
+	}
+	fcntl(l->fd, F_SETFD, FD_CLOEXEC); /* not for the child */
+
+	l->size = l->allocated = st.st_size;
+	if (opts.log.compress) {
+		if (!(l->z = lzwriter_open(l->fd))) {
+			if (first)
+				err(-1, "%s: can't append to it compressed", l->path);
+			give_up(l, "can't append to it compressed");
+			return;
+		}
+		l->size = l->allocated = lzwriter_size(l->z);
+	}
+	l->opened = monotonic_ns();
+	l->dirty = l->rotate_due = false;
+	l->bol = true;
+}
+
+static void __attribute__((nonnull))
+write_out(struct logfile *const l, size_t n)
+/* Write the first n bytes of the buffer */
+{
+	const char *p = l->buf;
+	const size_t total = n;
+
+	if (l->fd == -1)
+		return;
+
+#ifdef FALLOC_FL_KEEP_SIZE
+	/* Reserve the blocks ahead of time, so a long-lived log isn't
+	 * scattered all over the disk a few KiB at a time. KEEP_SIZE, so
+	 * the file doesn't look any bigger than what's in it, and anything
+	 * unused is given back by ftruncate(2) in close_log */
+	if (l->size + (off_t)n > l->allocated) {
+		off_t len = PREALLOC;
+		if (opts.log.size && l->allocated + len > (off_t)opts.log.size)
+			len = (off_t)opts.log.size - l->allocated;
+		if (len > 0
+		    && fallocate(l->fd, FALLOC_FL_KEEP_SIZE, l->allocated, len) == 0)
+			l->allocated += len;
+		else
+			l->allocated = l->size + n; /* don't try again till then */
+	}
+#endif
+
+	while (n) {
+		const ssize_t k = write(l->fd, p, n);
+		if (k == -1) {
+			if (errno == EINTR)
+				continue;
+			give_up(l, "write(2)");
+			return;
+		}
+		p += k, n -= k;
+	}
+
+	l->size += total;
+	l->dirty = true;
+	memmove(l->buf, l->buf + total, l->len -= total);
+}
+
+static __inline__ off_t __attribute__((nonnull))
+size_of(struct logfile *const l)
+/* For size=: compressed, it's whatever the thread's got done so far */
+{
+	return l->z ? lzwriter_size(l->z) : l->size + (off_t)l->len;
+}
+
+static void __attribute__((nonnull))
+sync_log(struct logfile *const l)
+{
+	write_out(l, l->len);
+	if (l->z) {
+		/* The thread sees to it, and we'll hear next time round if
+		 * it didn't go well. Only what it's written, whole blocks;
+		 * the one filling waits till it's full, or we're closing */
+		const int e = lzwriter_error(l->z);
+		if (e) {
+			errno = e;
+			give_up(l, "write(2)");
+		} else {
+			if (l->dirty)
+				lzwriter_sync(l->z);
+			l->size = lzwriter_size(l->z);
+			l->dirty = false;
+		}
+	} else if (l->fd != -1 && l->dirty) {
+		if (fdatasync(l->fd))
+			give_up(l, "fdatasync(2)");
+		l->dirty = false;
+	}
+	l->due = monotonic_ns() + (uint64_t)opts.log.sync_ms * NS_PER_MS;
+}
+
+static void __attribute__((nonnull))
+close_log(struct logfile *const l)
+{
+	sync_log(l);
+	if (l->z) {
+		lzwriter_flush(l->z, true);
+		if ((errno = lzwriter_close(l->z)))
+			warn("%s: write(2)", l->path);
+		l->z = NULL;
+	}
+	if (l->fd != -1) {
+#ifdef FALLOC_FL_KEEP_SIZE
+		if (!opts.log.compress && l->allocated > l->size)
+			ftruncate(l->fd, l->size);
+#endif
+		close(l->fd);
+		l->fd = -1;
+	}
+}
+
+static void __attribute__((nonnull))
+rotate(struct logfile *const l)
+/* PATH.(keep - 1) -> PATH.keep, ..., PATH -> PATH.1 */
+{
+	const size_t n = strlen(l->path) + 12;
+	char *const from = malloc(n), *const to = malloc(n);
+	int i;
+
+	if (!from || !to)
+		err(-1, NULL);
+
+	close_log(l);
+	for (i = opts.log.keep; i > 0; i--) {
+		if (i > 1)
+			snprintf(from, n, "%s.%d", l->path, i - 1);
+		else
+			strcpy(from, l->path);
+		snprintf(to, n, "%s.%d", l->path, i);
+		if (rename(from, to) && errno != ENOENT)
+			warn("rename(2): %s", from);
+	}
+	open_log(l, false);
+
+	free(from);
+	free(to);
+}
+
+static void __attribute__((nonnull))
+write_log(void *ctx __attribute__((unused)), const int ofd,
+		const struct iovec *const iov, const int iovcnt)
+/* ssss_write_fn: into the buffer, then out in whole blocks, lined up with
+ * the file's blocks, once there's a buffer's worth */
+{
+	struct logfile *const l = byfd[ofd - 1];
+	int i;
+
+	if (l->fd == -1)
+		return;
+
+	/* Only between lines, so that no line is split across files */
+	if (l->bol && (l->rotate_due
+	    || (opts.log.size && size_of(l) >= (off_t)opts.log.size)))
+		rotate(l);
+
+	/* The clock for syncing starts with the first write after the last
+	 * sync, so a trickle after a quiet spell still gets batched */
+	if (!l->len && !l->dirty)
+		l->due = monotonic_ns() + (uint64_t)opts.log.sync_ms * NS_PER_MS;
+
+	if (l->z) {
+		for (i = 0; i < iovcnt; i++) {
+			lzwriter_write(l->z, iov[i].iov_base, iov[i].iov_len);
+			if (iov[i].iov_len)
+				l->bol = ((const char *)iov[i].iov_base)[iov[i].iov_len - 1] == '\n';
+		}
+		l->dirty = true;
+		return;
+	}
+
+	for (i = 0; i < iovcnt; i++) {
+		const char *p = iov[i].iov_base;
+		size_t n = iov[i].iov_len;
+
+		while (n) {
+			const size_t k = n < BUF - l->len ? n : BUF - l->len;
+			memcpy(l->buf + l->len, p, k);
+			l->len += k, p += k, n -= k;
+
+			if (l->len == BUF)
+				/* Up to the last block boundary in the file.
+				 * BUF is more than a block, so that's never
+				 * nothing */
+				write_out(l, l->len - (size_t)((l->size + l->len) % BLOCK));
+		}
+		if (iov[i].iov_len)
+			l->bol = ((const char *)iov[i].iov_base)[iov[i].iov_len - 1] == '\n';
+	}
+}
+
+extern void
+logfile_open(void)
+{
+	int i;
+
+	if (!opts.log.sync_ms)
+		opts.log.sync_ms = SYNC_MS;
+	if (!opts.log.keep)
+		opts.log.keep = KEEP;
+
+	for (i = 0; i < 2; i++) {
+		if (!opts.log_path[i])
+			continue;
+		if (i == 1 && byfd[0] && strcmp(opts.log_path[0], opts.log_path[1]) == 0) {
+			byfd[1] = byfd[0];
+			break;
+		}
+
+		byfd[i] = &logs[nlogs++];
+		byfd[i]->path = opts.log_path[i];
+		if (!(byfd[i]->buf = malloc(BUF)))
+			err(-1, NULL);
+		byfd[i]->len = 0;
+		open_log(byfd[i], true);
+	}
+
+	/* Always timestamped; prefixed only when there's the both of them
+	 * to tell apart */
+	fmt = ssss_new(FLAG_TIMESTAMPS | (nlogs == 1 && byfd[0] == byfd[1] ? FLAG_PREFIX : 0),
+		write_log, NULL);
+}
+
+extern void __attribute__((nonnull, __access__(read_only, 2, 3)))
+logfile_feed(const int fd, const char *const buf, const size_t n)
+{
+	ssss_feed(fmt, fd, buf, n);
+}
+
+extern long
+logfile_prepare(void)
+{
+	const uint64_t now = monotonic_ns();
+	long ms = -1;
+	int i;
+
+	for (i = 0; i < nlogs; i++) {
+		if (logs[i].fd == -1)
+			continue;
+		if (logs[i].len || logs[i].dirty)
+			ms = sooner(ms, ms_between(now, logs[i].due));
+		if (opts.log.age_ms && !logs[i].rotate_due)
+			ms = sooner(ms, ms_between(now, logs[i].opened
+				+ (uint64_t)opts.log.age_ms * NS_PER_MS));
+	}
+
+	return ms;
+}
+
+extern void
+logfile_service(void)
+{
+	const uint64_t now = monotonic_ns();
+	int i;
+
+	for (i = 0; i < nlogs; i++) {
+		struct logfile *const l = &logs[i];
+		if (l->fd == -1)
+			continue;
+
+		if (opts.log.age_ms && !l->rotate_due
+		    && now >= l->opened + (uint64_t)opts.log.age_ms * NS_PER_MS)
+		{
+			/* Don't bother rotating an empty file, and leave it to
+			 * write_log if we're in the middle of a line */
+			if (!l->size && !l->len && !l->dirty)
+				l->opened = now;
+			else if (l->bol)
+				rotate(l);
+			else
+				l->rotate_due = true;
+		}
+		if ((l->len || l->dirty) && now >= l->due)
+			sync_log(l);
+	}
+}
+
+extern void
+logfile_close(void)
+{
+	int i;
+
+	for (i = 0; i < nlogs; i++) {
+		close_log(&logs[i]);
+		free(logs[i].buf);
+	}
+	ssss_free(fmt);
+}
@@ -0,0 +1,33 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef LOGFILE_H
+#define LOGFILE_H
+
+/* -l and -L: a copy of the child's output in files, one per stream or
+ * both in one, timestamped (and prefixed, if both in one) by a formatter
+ * of their own, whatever the terminal's getting. Output is collected and
+ * written in whole filesystem blocks where it can be, written out and
+ * fdatasync(2)ed every so often rather than every line, and rotated
+ * when the file gets too big or too old: PATH becomes PATH.1, PATH.1
+ * becomes PATH.2, and so on up to the number to keep. In place of
+ * `| tee >(rotatelogs ...)'. Or compressed, by a thread of its own, in
+ * blocks that can be got at one by one (see lz.h and lzwriter.h) */
+
+#include <stddef.h>
+
+#include "compat/__attribute__.h"
+
+extern void logfile_open(void);
+extern void logfile_feed(int fd, const char *buf, size_t n)
+	__attribute__((nonnull, __access__(read_only, 2, 3)));
+
+/* For parent_listen: returns how many ms until logfile_service needs
+ * calling, or -1 for never. logfile_service must be called after every
+ * select(2) */
+extern long logfile_prepare(void);
+extern void logfile_service(void);
+
+/* Write out and sync everything */
+extern void logfile_close(void);
+
+#endif /* LOGFILE_H */
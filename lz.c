@@ -0,0 +1,220 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#include "config.h"
+
+#include <string.h>	/* memcpy(3), memcmp(3), memset(3) */
+
+#include <unistd.h>	/* pread(2) */
+
+#include "lz.h"
+
+#include "compat/inline-restrict.h"
+#include "compat/__attribute__.h"
+
+#define HASH_BITS	14
+#define MAXOFF		65535
+/* Past this many bytes without a match, start taking bigger steps: it's
+ * probably not going to compress, and there's no sense crawling over it */
+#define SKIP_SHIFT	6
+
+static __inline__ uint32_t
+read32(const unsigned char *const p)
+/* Native-endian, which is fine: it's only ever compared, or hashed */
+{
+	uint32_t x;
+	memcpy(&x, p, sizeof x);
+	return x;
+}
+
+static __inline__ unsigned
+hash(const uint32_t x)
+{
+	return (x * 2654435761U) >> (32 - HASH_BITS) & ((1U << HASH_BITS) - 1);
+}
+
+static __inline__ unsigned char * __attribute__((nonnull, returns_nonnull))
+put_len(unsigned char *op, size_t len)
+/* The rest of a length that didn't fit in its nibble */
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+static __inline__ unsigned char * __attribute__((nonnull, returns_nonnull))
+put_literals(unsigned char *op, const unsigned char *const lit,
+		const size_t n, const unsigned low)
+/* A token, with low for its low nibble, and n literals */
+{
+	unsigned char *const token = op++;
+	if (n >= 15) {
+		*token = 15 << 4 | low;
+		op = put_len(op, n - 15);
+	} else
+		*token = n << 4 | low;
+	memcpy(op, lit, n);
+	return op + n;
+}
+
+extern size_t __attribute__((nonnull))
+lz_compress(const unsigned char *__restrict__ const src, const size_t n,
+		unsigned char *__restrict__ const dst)
+{
+	/* Where each hash of 4 bytes was last seen, as an offset into src,
+	 * which is less than LZ_BLOCK; 0 might as well mean nothing, since
+	 * it's checked anyway */
+	uint32_t table[1 << HASH_BITS];
+	unsigned char *op = dst;
+	size_t ip = 1, anchor = 0;
+
+	memset(table, 0, sizeof table);
+	if (n < LZ_MINMATCH + 1)
+		return put_literals(op, src, n, 0) - dst;
+
+	while (ip + LZ_MINMATCH <= n) {
+		const uint32_t x = read32(src + ip);
+		const unsigned h = hash(x);
+		size_t ref = table[h], len, ml;
+
+		table[h] = ip;
+		if (ip - ref > MAXOFF || read32(src + ref) != x) {
+			ip += 1 + ((ip - anchor) >> SKIP_SHIFT);
+			continue;
+		}
+
+		/* A match; as far as it goes, and back over what would
+		 * otherwise have been literals */
+		for (len = LZ_MINMATCH; ip + len < n && src[ref + len] == src[ip + len]; len++)
+			;
+		while (ip > anchor && ref && src[ip - 1] == src[ref - 1])
+			ip--, ref--, len++;
+
+		ml = len - LZ_MINMATCH;
+		op = put_literals(op, src + anchor, ip - anchor, ml >= 15 ? 15 : ml);
+		*op++ = (ip - ref) & 0xff;
+		*op++ = (ip - ref) >> 8;
+		if (ml >= 15)
+			op = put_len(op, ml - 15);
+
+		ip += len;
+		anchor = ip;
+		/* What's just gone by is as good a place as any to look
+		 * back to */
+		if (ip + LZ_MINMATCH <= n)
+			table[hash(read32(src + ip - 2))] = ip - 2;
+	}
+
+	return put_literals(op, src + anchor, n - anchor, 0) - dst;
+}
+
+extern long __attribute__((nonnull))
+lz_decompress(const unsigned char *__restrict__ src, const size_t n,
+		unsigned char *__restrict__ const dst, const size_t cap)
+{
+	const unsigned char *const end = src + n;
+	size_t op = 0;
+
+	while (src < end) {
+		const unsigned token = *src++;
+		size_t len = token >> 4, off;
+
+		if (len == 15) {
+			unsigned char b;
+			do {
+				if (src == end)
+					return -1;
+				len += b = *src++;
+			} while (b == 255);
+		}
+		if ((size_t)(end - src) < len || cap - op < len)
+			return -1;
+		memcpy(dst + op, src, len);
+		src += len, op += len;
+		if (src == end)
+			break;
+
+		if (end - src < 2)
+			return -1;
+		off = src[0] | src[1] << 8;
+		src += 2;
+		len = (token & 15) + LZ_MINMATCH;
+		if ((token & 15) == 15) {
+			unsigned char b;
+			do {
+				if (src == end)
+					return -1;
+				len += b = *src++;
+			} while (b == 255);
+		}
+		if (!off || off > op || cap - op < len)
+			return -1;
+
+		/* A byte at a time, since it may well overlap itself; runs
+		 * of the one character are the usual way of that */
+		{
+			const unsigned char *from = dst + op - off;
+			unsigned char *to = dst + op;
+			op += len;
+			while (len--)
+				*to++ = *from++;
+		}
+	}
+
+	return op;
+}
+
+extern void __attribute__((nonnull))
+lz_header(unsigned char *const p, const unsigned long clen, const unsigned long n,
+		const uint64_t raw)
+{
+	memcpy(p, LZ_MAGIC, 4);
+	lz_put(p + 4, clen, 4);
+	lz_put(p + 8, n, 4);
+	lz_put(p + 12, raw, 8);
+}
+
+extern int __attribute__((nonnull))
+lz_read_header(const unsigned char *const p, unsigned long *const clen,
+		unsigned long *const n, uint64_t *const raw)
+{
+	if (memcmp(p, LZ_MAGIC, 4))
+		return -1;
+	*clen = lz_get(p + 4, 4);
+	*n = lz_get(p + 8, 4);
+	*raw = lz_get(p + 12, 8);
+	if (*n > LZ_BLOCK || (*clen & ~LZ_STORED) > LZ_BOUND(LZ_BLOCK)
+	    || (*clen & LZ_STORED && (*clen & ~LZ_STORED) != *n))
+		return -1;
+	return 0;
+}
+
+extern off_t __attribute__((nonnull))
+lz_end(const int fd, uint64_t *const raw)
+{
+	unsigned char h[LZ_HEADER];
+	off_t at = 0;
+	unsigned long clen, n;
+	uint64_t from;
+
+	*raw = 0;
+	for (;;) {
+		const ssize_t k = pread(fd, h, sizeof h, at);
+		off_t next;
+		unsigned char last;
+
+		/* The end, or a header cut short: so long as what there
+		 * is of it is a header's, it's ours */
+		if (k < (ssize_t)sizeof h)
+			return k != -1 && !memcmp(h, LZ_MAGIC, k < 4 ? k : 4) ? at : -1;
+		if (lz_read_header(h, &clen, &n, &from) || from != *raw)
+			return -1;
+
+		/* Is all of it there? */
+		next = at + LZ_HEADER + (off_t)(clen & ~LZ_STORED);
+		if (pread(fd, &last, 1, next - 1) != 1)
+			return at;
+		at = next;
+		*raw = from + n;
+	}
+}
@@ -0,0 +1,85 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef LZ_H
+#define LZ_H
+
+/* -L compress: a byte-oriented LZ77 of the LZ4 family, in-tree so there's
+ * nothing else to link, for -l's logs. It's after speed more than size,
+ * and logs being what they are, that still comes to a good deal smaller.
+ *
+ * A compressed log is a run of blocks, each of them complete in itself,
+ *
+ *	4	"SSZ1"
+ *	u32	length of what follows; LZ_STORED set if it's as it was,
+ *		compressing having made it no smaller
+ *	u32	length uncompressed, at most LZ_BLOCK
+ *	u64	where it starts in the uncompressed log
+ *
+ * then that many bytes; integers big-endian, like -X's. So to start
+ * anywhere in a log, hop from header to header till the one that has it, and
+ * uncompress from there; ssss-unz does. A block cut short by a crash is
+ * dropped, and the log carries on after it, when ssss next opens it.
+ *
+ * In a block, each sequence is a token byte, literal length in the high
+ * nibble and match length less LZ_MINMATCH in the low, 15 meaning more
+ * bytes of it to follow, each adding to it till one's less than 255; the
+ * literals; a 16-bit little-endian offset back to the match; the rest of
+ * the match length. The last is only literals, and stops where the block
+ * does */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>	/* off_t */
+
+#include "compat/inline-restrict.h"
+#include "compat/__attribute__.h"
+
+#define LZ_MAGIC	"SSZ1"
+#define LZ_HEADER	20
+#define LZ_BLOCK	(256 * 1024)
+#define LZ_STORED	0x80000000UL
+#define LZ_MINMATCH	4
+/* The most a block can come to compressed, literals' lengths and all */
+#define LZ_BOUND(n)	((n) + (n) / 255 + 16)
+
+static __inline__ void __attribute__((nonnull))
+lz_put(unsigned char *const p, uint64_t x, int n)
+{
+	while (n--)
+		p[n] = x & 0xff, x >>= 8;
+}
+
+static __inline__ uint64_t __attribute__((nonnull))
+lz_get(const unsigned char *const p, const int n)
+{
+	uint64_t x = 0;
+	int i;
+	for (i = 0; i < n; i++)
+		x = x << 8 | p[i];
+	return x;
+}
+
+/* Of n bytes of src, at most LZ_BLOCK, into dst, which has room for
+ * LZ_BOUND(n). Returns how much of dst it took */
+extern size_t lz_compress(const unsigned char *__restrict__ src, size_t n,
+		unsigned char *__restrict__ dst) __attribute__((nonnull));
+
+/* And back, into at most cap bytes. Returns how many, or -1 if it's not
+ * what lz_compress would make of anything */
+extern long lz_decompress(const unsigned char *__restrict__ src, size_t n,
+		unsigned char *__restrict__ dst, size_t cap) __attribute__((nonnull));
+
+/* Header of a block of n bytes, of which clen compressed (| LZ_STORED),
+ * starting at raw in the uncompressed log; and back again, returning -1 if
+ * it's not a header */
+extern void lz_header(unsigned char *p, unsigned long clen, unsigned long n,
+		uint64_t raw) __attribute__((nonnull));
+extern int lz_read_header(const unsigned char *p, unsigned long *clen,
+		unsigned long *n, uint64_t *raw) __attribute__((nonnull));
+
+/* For appending to a log: where the last whole block in fd ends, and in
+ * *raw, how much it all comes to uncompressed. -1 if fd's not a log, or
+ * not one to append to: anything past that block but a block cut short */
+extern off_t lz_end(int fd, uint64_t *raw) __attribute__((nonnull));
+
+#endif /* LZ_H */
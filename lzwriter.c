@@ -0,0 +1,252 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#include "config.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>	/* pthread_sigmask(3) */
+#include <stdlib.h>	/* malloc(3), free(3) */
+#include <string.h>	/* memcpy(3) */
+
+#include <err.h>
+#include <unistd.h>	/* write(2), fdatasync(2), ftruncate(2) */
+
+#include "lz.h"
+#include "lzwriter.h"
+
+#include "compat/bool.h"
+#include "compat/inline-restrict.h"
+#include "compat/__attribute__.h"
+
+struct lzwriter {
+	int fd;
+	pthread_t thread;
+
+	/* The main thread's: the block being filled, and how much of it */
+	unsigned char *block[2];
+	int filling;
+	size_t len;
+
+	/* The thread's: where it compresses to, and where in the
+	 * uncompressed log the next block it writes starts */
+	unsigned char *out;
+	uint64_t raw;
+
+	/* Between the two of them, under lock */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	const unsigned char *job;	/* NULL if the thread's free */
+	size_t job_len;
+	bool sync;	/* fdatasync(2) once it's written what it's got */
+	bool closing;
+	off_t size;
+	int error;
+};
+
+static int __attribute__((nonnull))
+write_all(const int fd, const unsigned char *p, size_t n)
+/* Returns an errno, or 0 */
+{
+	while (n) {
+		const ssize_t k = write(fd, p, n);
+		if (k == -1) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		p += k, n -= k;
+	}
+	return 0;
+}
+
+static int __attribute__((nonnull))
+squash(struct lzwriter *const z, const unsigned char *const p, const size_t n,
+		off_t *const written)
+/* One block, out to the file: compressed if that makes it any smaller.
+ * Returns an errno, or 0 */
+{
+	unsigned long clen = lz_compress(p, n, z->out + LZ_HEADER);
+
+	if (clen >= n) {
+		memcpy(z->out + LZ_HEADER, p, n);
+		clen = n | LZ_STORED;
+	}
+	lz_header(z->out, clen, n, z->raw);
+	z->raw += n;
+	*written = LZ_HEADER + (clen & ~LZ_STORED);
+	return write_all(z->fd, z->out, *written);
+}
+
+static void *
+run(void *const arg)
+{
+	struct lzwriter *const z = arg;
+
+	pthread_mutex_lock(&z->lock);
+	for (;;) {
+		const unsigned char *job;
+		size_t n;
+		bool sync;
+		off_t written = 0;
+		int e;
+
+		while (!z->job && !z->sync && !z->closing)
+			pthread_cond_wait(&z->cond, &z->lock);
+		if (!z->job && !z->sync)
+			break;
+		job = z->job, n = job ? z->job_len : 0, sync = z->sync, e = z->error;
+		z->sync = false;
+		pthread_mutex_unlock(&z->lock);
+
+		if (n && !e)
+			e = squash(z, job, n, &written);
+		if (sync && !e && fdatasync(z->fd))
+			e = errno;
+
+		pthread_mutex_lock(&z->lock);
+		z->size += written;
+		z->error = e;
+		if (job)
+			z->job = NULL;
+		pthread_cond_broadcast(&z->cond);
+	}
+	pthread_mutex_unlock(&z->lock);
+	return NULL;
+}
+
+extern struct lzwriter *
+lzwriter_open(const int fd)
+{
+	struct lzwriter *z;
+	sigset_t all, old;
+	uint64_t raw;
+	off_t end;
+
+	/* Pick up where the last ssss left off, minus whatever it didn't
+	 * get to finish; but only if it's an ssss's to begin with. Anything
+	 * else isn't ours to cut short */
+	if ((end = lz_end(fd, &raw)) == -1) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (ftruncate(fd, end) || lseek(fd, end, SEEK_SET) == -1)
+		return NULL;
+
+	if (!(z = malloc(sizeof *z)) || !(z->block[0] = malloc(LZ_BLOCK))
+	    || !(z->block[1] = malloc(LZ_BLOCK))
+	    || !(z->out = malloc(LZ_HEADER + LZ_BOUND(LZ_BLOCK))))
+		err(-1, NULL);
+
+	z->fd = fd;
+	z->raw = raw;
+	z->filling = 0;
+	z->len = 0;
+	z->job = NULL;
+	z->sync = z->closing = false;
+	z->size = end;
+	z->error = 0;
+	pthread_mutex_init(&z->lock, NULL);
+	pthread_cond_init(&z->cond, NULL);
+
+	/* Signals are for the main thread, and sigevent's signalfd(2) in
+	 * particular: any the thread didn't block, it might take instead,
+	 * and then they'd never be seen */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	if ((errno = pthread_create(&z->thread, NULL, run, z)))
+		err(-1, "pthread_create(3)");
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	return z;
+}
+
+static void __attribute__((nonnull))
+hand_over(struct lzwriter *const z)
+/* The block that's filling, to the thread, once it's done with the other
+ * one; then that one's to fill */
+{
+	pthread_mutex_lock(&z->lock);
+	while (z->job)
+		pthread_cond_wait(&z->cond, &z->lock);
+	z->job = z->block[z->filling];
+	z->job_len = z->len;
+	pthread_cond_broadcast(&z->cond);
+	pthread_mutex_unlock(&z->lock);
+
+	z->filling ^= 1;
+	z->len = 0;
+}
+
+extern void __attribute__((nonnull, __access__(read_only, 2, 3)))
+lzwriter_write(struct lzwriter *const z, const char *buf, size_t n)
+{
+	while (n) {
+		const size_t k = n < LZ_BLOCK - z->len ? n : LZ_BLOCK - z->len;
+		memcpy(z->block[z->filling] + z->len, buf, k);
+		z->len += k, buf += k, n -= k;
+		if (z->len == LZ_BLOCK)
+			hand_over(z);
+	}
+}
+
+extern void __attribute__((nonnull))
+lzwriter_sync(struct lzwriter *const z)
+{
+	/* No waiting for it: if it's in the middle of a block, it's
+	 * after that one */
+	pthread_mutex_lock(&z->lock);
+	z->sync = true;
+	pthread_cond_broadcast(&z->cond);
+	pthread_mutex_unlock(&z->lock);
+}
+
+extern void __attribute__((nonnull))
+lzwriter_flush(struct lzwriter *const z, const bool sync)
+{
+	if (z->len)
+		hand_over(z);
+	if (sync)
+		lzwriter_sync(z);
+}
+
+extern off_t __attribute__((nonnull))
+lzwriter_size(struct lzwriter *const z)
+{
+	off_t size;
+	pthread_mutex_lock(&z->lock);
+	size = z->size;
+	pthread_mutex_unlock(&z->lock);
+	return size;
+}
+
+extern int __attribute__((nonnull))
+lzwriter_error(struct lzwriter *const z)
+{
+	int e;
+	pthread_mutex_lock(&z->lock);
+	e = z->error;
+	pthread_mutex_unlock(&z->lock);
+	return e;
+}
+
+extern int __attribute__((nonnull))
+lzwriter_close(struct lzwriter *const z)
+{
+	int e;
+
+	lzwriter_flush(z, false);
+	pthread_mutex_lock(&z->lock);
+	z->closing = true;
+	pthread_cond_broadcast(&z->cond);
+	pthread_mutex_unlock(&z->lock);
+	pthread_join(z->thread, NULL);
+
+	e = z->error;
+	pthread_mutex_destroy(&z->lock);
+	pthread_cond_destroy(&z->cond);
+	free(z->block[0]);
+	free(z->block[1]);
+	free(z->out);
+	free(z);
+	return e;
+}
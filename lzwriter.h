@@ -0,0 +1,47 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef LZWRITER_H
+#define LZWRITER_H
+
+/* Compressing to a file (see lz.h), on a thread of its own, so that the
+ * compressing and the writing and the fdatasync(2)ing are none of them
+ * done in the middle of reading from the child. Two blocks: one being
+ * filled, the other being compressed and written; the only time anything
+ * waits on the thread is when the one's full before the other's done,
+ * which is to say when there's more output than the disk can take even
+ * compressed, and then there's nothing else for it */
+
+#include <stddef.h>
+#include <sys/types.h>	/* off_t */
+
+#include "compat/bool.h"
+#include "compat/__attribute__.h"
+
+struct lzwriter;
+
+/* Onto the end of fd, which it's up to the caller to close after
+ * lzwriter_close. A block cut short at the end is cut off first; NULL,
+ * with errno, if that can't be done, or EINVAL if fd's something other
+ * than a compressed log, which is left as it is */
+extern struct lzwriter *lzwriter_open(int fd) __attribute__((malloc));
+extern void lzwriter_write(struct lzwriter *z, const char *buf, size_t n)
+	__attribute__((nonnull, __access__(read_only, 2, 3)));
+
+/* Have the thread fdatasync(2) the blocks it's written, once it's done
+ * with the one it's on. The one being filled stays where it is, for a
+ * sync every second not to cut a block every second */
+extern void lzwriter_sync(struct lzwriter *z) __attribute__((nonnull));
+
+/* Hand over the block being filled, however little's in it, and
+ * lzwriter_sync if sync: for rotating and closing */
+extern void lzwriter_flush(struct lzwriter *z, bool sync) __attribute__((nonnull));
+
+/* How much the file's come to so far, compressed, as of the last block
+ * the thread's finished; and an errno if it's given up, else 0 */
+extern off_t lzwriter_size(struct lzwriter *z) __attribute__((nonnull));
+extern int lzwriter_error(struct lzwriter *z) __attribute__((nonnull));
+
+/* Write out the rest and see the thread off; returns lzwriter_error's */
+extern int lzwriter_close(struct lzwriter *z) __attribute__((nonnull));
+
+#endif /* LZWRITER_H */
@@ -0,0 +1,224 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * -M: serve counters on an AF_UNIX socket, in the Prometheus text
+ * exposition format. Each connection gets one snapshot and is closed, so
+ * `nc -U PATH' or `socat - UNIX-CONNECT:PATH' is a whole scraper. All the
+ * work of serving happens here, between select(2)s in parent_listen; the
+ * read path only ever bumps counters */
+#include "config.h"
+
+#include <errno.h>
+#include <signal.h>	/* siginfo_t */
+#include <stdarg.h>
+#include <stdio.h>	/* vsnprintf(3) */
+#include <stdlib.h>	/* atexit(3) */
+#include <string.h>	/* strlen(3), memcpy(3) */
+
+#include <err.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>	/* lstat(2) */
+#include <sys/un.h>
+#include <sys/wait.h>	/* waitid(2) */
+#include <unistd.h>
+
+#ifdef HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#elif defined HAVE_IOCTL_H
+#include <ioctl.h>
+#elif defined HAVE_STROPTS_H
+#include <stropts.h>
+#endif /* HAVE_SYS_IOCTL_H */
+
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>	/* FD_SETSIZE */
+#else
+#include <sys/time.h>
+#endif
+
+#include "metrics.h"
+
+#include "compat/__attribute__.h"
+
+struct metrics metrics = {
+	-1, 0, { -1, -1 }, { { 0, 0, 0 }, { 0, 0, 0 } }, 0,
+	0, 0, -1, 0, 0
+};
+
+static const char *sock_path = NULL;
+
+static void
+unlink_sock(void)
+{
+	unlink(sock_path);
+}
+
+extern void __attribute__((nonnull))
+metrics_listen(const char *const path)
+{
+	union {
+		struct sockaddr sa;
+		struct sockaddr_un un;
+	} addr;
+	struct stat st;
+	const size_t len = strlen(path);
+
+	if (len >= sizeof addr.un.sun_path)
+		errx(-1, "%s: socket path too long", path);
+
+	memset(&addr, 0, sizeof addr);
+	addr.un.sun_family = AF_UNIX;
+	memcpy(addr.un.sun_path, path, len);
+
+	/* Clear away a stale socket from a previous run, but nothing else */
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	metrics.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (metrics.fd == -1
+	    || bind(metrics.fd, &addr.sa, sizeof addr.un) != 0
+	    || listen(metrics.fd, 8) != 0)
+		err(-1, "%s", path);
+	if (metrics.fd >= FD_SETSIZE)
+		errx(-1, "%s: too many files open already for select(2)", path);
+
+	fcntl(metrics.fd, F_SETFL, O_NONBLOCK);
+	fcntl(metrics.fd, F_SETFD, FD_CLOEXEC); /* not for the child */
+
+	sock_path = path;
+	atexit(unlink_sock);
+}
+
+extern void
+metrics_count(const int fd, const size_t n, const unsigned long lines)
+{
+	metrics.stream[fd - 1].bytes += n;
+	metrics.stream[fd - 1].chunk = n;
+	metrics.stream[fd - 1].lines = lines;
+}
+
+static int
+queued(const int fd)
+/* Bytes sitting in the pipe that we haven't read yet */
+{
+#ifdef FIONREAD
+	int n;
+	if (fd != -1 && ioctl(fd, FIONREAD, &n) == 0)
+		return n;
+#else
+	(void)fd;
+#endif
+	return 0;
+}
+
+struct textbuf {
+	char buf[4096];
+	size_t n;
+};
+
+static void __attribute__((nonnull, format(printf, 2, 3)))
+append(struct textbuf *const t, const char *const fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (t->n >= sizeof t->buf)
+		return;
+	va_start(ap, fmt);
+	n = vsnprintf(t->buf + t->n, sizeof t->buf - t->n, fmt, ap);
+	va_end(ap);
+	if (n > 0)
+		t->n += n;
+	if (t->n > sizeof t->buf)
+		t->n = sizeof t->buf;
+}
+
+static void __attribute__((nonnull))
+per_stream(struct textbuf *const t, const char *const name,
+	const char *const type, const char *const help,
+	const unsigned long val[2])
+{
+	append(t, "# HELP ssss_%s %s\n# TYPE ssss_%s %s\n"
+		"ssss_%s{stream=\"stdout\"} %lu\n"
+		"ssss_%s{stream=\"stderr\"} %lu\n",
+		name, help, name, type, name, val[0], name, val[1]);
+}
+
+static void __attribute__((nonnull))
+format_metrics(struct textbuf *const t)
+{
+	unsigned long val[2];
+	siginfo_t si;
+	size_t i;
+
+	t->n = 0;
+
+	for (i = 0; i < 2; i++) val[i] = metrics.stream[i].bytes;
+	per_stream(t, "bytes_total", "counter", "Bytes read from the child", val);
+	for (i = 0; i < 2; i++) val[i] = metrics.stream[i].lines;
+	per_stream(t, "lines_total", "counter", "Newlines read from the child", val);
+	for (i = 0; i < 2; i++) val[i] = metrics.stream[i].chunk;
+	per_stream(t, "read_chunk_bytes", "gauge", "Size of the last read(2)", val);
+	for (i = 0; i < 2; i++) val[i] = queued(metrics.child_fds[i]);
+	per_stream(t, "queued_bytes", "gauge",
+		"Bytes waiting in the pipe from the child", val);
+
+	append(t, "# HELP ssss_output_blocked_seconds_total Time spent between select(2)s seeing to output, writing it included\n"
+		"# TYPE ssss_output_blocked_seconds_total counter\n"
+		"ssss_output_blocked_seconds_total %lu.%06lu\n",
+		(unsigned long)(metrics.busy_ns / 1000000000),
+		(unsigned long)(metrics.busy_ns % 1000000000 / 1000));
+
+	if (metrics.remote_up != -1)
+		append(t, "# HELP ssss_remote_up Whether -R is connected\n"
+			"# TYPE ssss_remote_up gauge\nssss_remote_up %d\n"
+			"# HELP ssss_remote_backlog_bytes Records queued for -R\n"
+			"# TYPE ssss_remote_backlog_bytes gauge\nssss_remote_backlog_bytes %lu\n"
+			"# HELP ssss_remote_dropped_total Records dropped with the backlog full\n"
+			"# TYPE ssss_remote_dropped_total counter\nssss_remote_dropped_total %lu\n",
+			metrics.remote_up, metrics.remote_backlog, metrics.remote_dropped);
+
+	append(t, "# HELP ssss_child_pid PID of the child\n"
+		"# TYPE ssss_child_pid gauge\nssss_child_pid %ld\n",
+		(long)metrics.child);
+
+	/* WNOWAIT leaves the child for parent_wait_for_child to reap */
+	si.si_pid = 0;
+	if (metrics.child_reaped) {
+		si.si_pid = metrics.child;
+		si.si_code = WIFEXITED(metrics.child_status) ? CLD_EXITED : CLD_KILLED;
+		si.si_status = WIFEXITED(metrics.child_status)
+			? WEXITSTATUS(metrics.child_status)
+			: WTERMSIG(metrics.child_status);
+	} else if (waitid(P_PID, metrics.child, &si, WEXITED | WNOHANG | WNOWAIT) != 0)
+		si.si_pid = 0;
+	append(t, "# HELP ssss_child_running Whether the child is still running\n"
+		"# TYPE ssss_child_running gauge\nssss_child_running %d\n",
+		si.si_pid == 0);
+	if (si.si_pid != 0)
+		append(t, "# HELP ssss_child_status Exit status, or signal number if killed\n"
+			"# TYPE ssss_child_status gauge\nssss_child_status{how=\"%s\"} %d\n",
+			si.si_code == CLD_EXITED ? "exited" : "killed",
+			si.si_status);
+}
+
+extern void
+metrics_serve(void)
+{
+	struct textbuf t;
+	int fd;
+
+	while ((fd = accept(metrics.fd, NULL, NULL)) != -1) {
+		/* Don't let a scraper that won't read hang us */
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		format_metrics(&t);
+		if (write(fd, t.buf, t.n) == -1 && errno != EAGAIN)
+			warn("metrics: write(2)");
+		close(fd);
+	}
+
+	if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED
+	    && errno != EINTR)
+		warn("metrics: accept(2)");
+}
@@ -0,0 +1,40 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>	/* pid_t */
+
+#include "compat/__attribute__.h"
+
+/* Counters served over -M. Everything in here is only touched when
+ * metrics.fd != -1, so with -M unset the hot path pays one branch */
+extern struct metrics {
+	int fd;		/* listening AF_UNIX socket, or -1 */
+	pid_t child;
+	int child_fds[2]; /* read ends of the child's pipes, [0] for &1 and
+			   * [1] for &2, for FIONREAD */
+	struct {
+		unsigned long bytes, lines;
+		unsigned long chunk; /* size of the last read(2) */
+	} stream[2];	/* indexed by fd - 1, like child_fds */
+	uint64_t busy_ns; /* total time between select(2)s, seeing to output */
+
+	/* Set by parent_listen once it's reaped the child, which leaves
+	 * nothing for waitid(2) to look at */
+	int child_reaped, child_status;
+
+	/* -R, kept up to date by remote.c */
+	int remote_up;	/* -1 if there's no -R */
+	unsigned long remote_backlog, remote_dropped;
+} metrics;
+
+extern void metrics_listen(const char *path) __attribute__((nonnull));
+/* A read(2) of n bytes from fd, which made lines newlines so far, as the
+ * formatter counted them (ssss_lines) */
+extern void metrics_count(int fd, size_t n, unsigned long lines);
+extern void metrics_serve(void);
+
+#endif /* METRICS_H */
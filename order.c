@@ -0,0 +1,275 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * How well does ssss keep the order of its child's output? (See BUGS in
+ * README.md.) This runs ssss in each mode on a child -- itself, again --
+ * that writes numbered records to fd 1 and 2 by turns, with ssss's stdout
+ * and stderr both on the one pipe, as they would be on a terminal or after
+ * `2>&1', and reads back what order they came out in. `make order' builds
+ * it. Output is tab-separated, like bench's, one line per mode:
+ *
+ *	missing		records that never turned up (should be 0!)
+ *	reordered	records that came out after one numbered higher
+ *	max_disp	furthest any record came out from its place
+ *	secs, MB_s	how long ssss took, and its throughput
+ *
+ * Records are `@SEQ ' padded with x to -s bytes, newline included, which
+ * shows up intact in the output of every mode. The child writes them -r
+ * a second (0 for as fast as it can), with -b none (a write(2) each),
+ * line (stdio, line-buffered, as a program on a terminal would) or full
+ * (stdio, fully buffered, as it would on a pipe -- expect chaos):
+ *
+ *	$ ./order -n 100000 -b line > before.tsv
+ *	$ git checkout ...; make order ssss; ./order -n 100000 -b line > after.tsv
+ *
+ * -m MODE (eg. -m '-1 -t'; repeatable) picks the modes, else all of them.
+ * -x PATH is the ssss to run, ./ssss by default */
+#include "config.h"
+
+#if _POSIX_C_SOURCE < 199309L
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>	/* malloc(3), realloc(3), strtoul(3) */
+#include <string.h>
+#include <time.h>	/* nanosleep(2) */
+
+#include <err.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>	/* getopt(3), pipe(2), fork(2), execv(2) */
+
+#include "timestamp.h"
+
+#include "compat/__attribute__.h"
+
+#define MAXMODES 16
+#define MAXARGS 8	/* per mode */
+
+static const char *const default_modes[] = {
+	"", "-1", "-t", "-1 -t", "-c", "-1 -c", "-S", "-S -t", "-j", "-1 -j"
+};
+
+struct params {
+	unsigned long n, size, rate;
+	const char *buffering;
+};
+
+static void __attribute__((nonnull))
+be_child(const struct params *const p)
+/* Write the records, and that's all */
+{
+	char *const rec = malloc(p->size + 32);
+	struct timespec gap;
+	unsigned long i;
+	enum { NONE, LINE, FULL } buf =
+		strcmp(p->buffering, "full") == 0 ? FULL
+		: strcmp(p->buffering, "line") == 0 ? LINE
+		: NONE;
+
+	if (!rec)
+		err(-1, NULL);
+	if (buf != NONE) {
+		setvbuf(stdout, NULL, buf == LINE ? _IOLBF : _IOFBF, BUFSIZ);
+		setvbuf(stderr, NULL, buf == LINE ? _IOLBF : _IOFBF, BUFSIZ);
+	}
+	if (p->rate) {
+		gap.tv_sec = 1 / p->rate;
+		gap.tv_nsec = 1000000000 / p->rate % 1000000000;
+	}
+
+	for (i = 0; i < p->n; i++) {
+		const int fd = 1 + (i & 1);
+		size_t len = sprintf(rec, "@%lu ", i);
+		while (len < p->size - 1)
+			rec[len++] = 'x';
+		rec[len++] = '\n';
+
+		if (buf == NONE) {
+			if (write(fd, rec, len) != (ssize_t)len)
+				err(-1, "write(2)");
+		} else
+			fwrite(rec, 1, len, fd == 1 ? stdout : stderr);
+
+		if (p->rate)
+			nanosleep(&gap, NULL);
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	exit(0);
+}
+
+static char * __attribute__((nonnull))
+run(const char *const ssss, const char *const self, const char *const mode,
+	const struct params *const p, size_t *const len, double *const secs)
+/* Run ssss MODE self -X ..., and return everything it output, in *len
+ * bytes */
+{
+	char *argv[MAXARGS + 12], *modebuf, *tok, nbuf[24], sbuf[24], rbuf[24];
+	char *out = NULL;
+	size_t cap = 0;
+	int fds[2], i = 0, status;
+	uint64_t t0;
+	pid_t pid;
+
+	if (!(modebuf = malloc(strlen(mode) + 1)))
+		err(-1, NULL);
+	strcpy(modebuf, mode);
+
+	argv[i++] = (char *)ssss;
+	for (tok = strtok(modebuf, " "); tok && i <= MAXARGS; tok = strtok(NULL, " "))
+		argv[i++] = tok;
+	sprintf(nbuf, "%lu", p->n);
+	sprintf(sbuf, "%lu", p->size);
+	sprintf(rbuf, "%lu", p->rate);
+	argv[i++] = (char *)self;
+	argv[i++] = "-X";
+	argv[i++] = "-n"; argv[i++] = nbuf;
+	argv[i++] = "-s"; argv[i++] = sbuf;
+	argv[i++] = "-r"; argv[i++] = rbuf;
+	argv[i++] = "-b"; argv[i++] = (char *)p->buffering;
+	argv[i] = NULL;
+
+	if (pipe(fds))
+		err(-1, "pipe(2)");
+
+	t0 = monotonic_ns();
+	switch ((pid = fork())) {
+	case -1:
+		err(-1, "fork(2)");
+	case 0:
+		dup2(fds[1], STDOUT_FILENO);
+		dup2(fds[1], STDERR_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		execv(ssss, argv);
+		err(-1, "%s", ssss);
+	}
+	close(fds[1]);
+
+	*len = 0;
+	for (;;) {
+		ssize_t k;
+		if (cap - *len < BUFSIZ) {
+			cap = cap ? cap * 2 : 1 << 20;
+			if (!(out = realloc(out, cap)))
+				err(-1, NULL);
+		}
+		if ((k = read(fds[0], out + *len, cap - *len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			err(-1, "read(2)");
+		}
+		if (k == 0)
+			break;
+		*len += k;
+	}
+	close(fds[0]);
+
+	waitpid(pid, &status, 0);
+	*secs = (monotonic_ns() - t0) / 1e9;
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		warnx("%s %s: exited %d", ssss, mode, status);
+
+	free(modebuf);
+	return out;
+}
+
+static void __attribute__((nonnull))
+score(const char *const mode, const struct params *const p,
+	const char *const out, const size_t len, const double secs)
+/* Find every @SEQ in out, in order: one a line, or two in -S's rows */
+{
+	unsigned char *const seen = calloc(p->n, 1);
+	unsigned long pos = 0, missing = 0, reordered = 0, max_disp = 0, max = 0, i;
+	const char *s = out, *const end = out + len;
+
+	if (!seen)
+		err(-1, NULL);
+
+	while ((s = memchr(s, '@', end - s))) {
+		unsigned long seq = 0;
+		const char *d = ++s;
+
+		while (d < end && *d >= '0' && *d <= '9')
+			seq = seq * 10 + (*d++ - '0');
+		if (d == s || d == end || *d != ' ' || seq >= p->n || seen[seq])
+			continue;
+		seen[seq] = 1;
+
+		if (pos && seq < max)
+			reordered++;
+		if (seq > max)
+			max = seq;
+		if ((seq > pos ? seq - pos : pos - seq) > max_disp)
+			max_disp = seq > pos ? seq - pos : pos - seq;
+		pos++;
+	}
+	for (i = 0; i < p->n; i++)
+		missing += !seen[i];
+
+	printf("%s\t%s\t%s\t%lu\t%lu\t%lu\t%lu\t%lu\t%.4f\t%lu\t%.3f\t%.1f\n",
+		SSSS_VERSION, *mode ? mode : "(none)", p->buffering, p->size,
+		p->rate, p->n, missing, reordered, (double)reordered / p->n,
+		max_disp, secs, len / secs / 1e6);
+	fflush(stdout);
+	free(seen);
+}
+
+int
+main(const int argc, char *const *const argv)
+{
+	struct params p;
+	const char *modes[MAXMODES], *ssss = "./ssss";
+	int nmodes = 0, child = 0, o, i;
+
+	p.n = 10000, p.size = 32, p.rate = 0, p.buffering = "none";
+
+	while ((o = getopt(argc, argv, "Xb:m:n:r:s:x:")) != -1)
+		switch (o) {
+		case 'X':	child = 1; break;
+		case 'b':	p.buffering = optarg; break;
+		case 'm':
+			if (nmodes == MAXMODES)
+				errx(-1, "-m: no more than %d", MAXMODES);
+			modes[nmodes++] = optarg;
+			break;
+		case 'n':	p.n = strtoul(optarg, NULL, 0); break;
+		case 'r':	p.rate = strtoul(optarg, NULL, 0); break;
+		case 's':	p.size = strtoul(optarg, NULL, 0); break;
+		case 'x':	ssss = optarg; break;
+		default:
+			fprintf(stderr, "Usage: %s [-b none|line|full] [-m MODE]... [-n RECORDS]\n"
+				"\t[-r RECORDS_PER_SEC] [-s RECORD_BYTES] [-x SSSS]\n", argv[0]);
+			return -1;
+		}
+	if (strcmp(p.buffering, "none") && strcmp(p.buffering, "line")
+	    && strcmp(p.buffering, "full"))
+		errx(-1, "-b: none, line or full");
+	if (p.size < 24)
+		p.size = 24; /* room for @SEQ and then some */
+	if (!p.n)
+		errx(-1, "-n: at least one, please");
+
+	if (child)
+		be_child(&p);
+
+	if (!nmodes)
+		for (; nmodes < (int)(sizeof default_modes / sizeof *default_modes); nmodes++)
+			modes[nmodes] = default_modes[nmodes];
+
+	puts("version\tmode\tbuffering\tsize\trate\trecords\tmissing\treordered\treorder_rate\tmax_disp\tsecs\tMB_s");
+	for (i = 0; i < nmodes; i++) {
+		size_t len;
+		double secs;
+		char *const out = run(ssss, argv[0], modes[i], &p, &len, &secs);
+		score(modes[i], &p, out, len, secs);
+		free(out);
+	}
+
+	return 0;
+}
@@ -0,0 +1,60 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef PREFIX_H
+#define PREFIX_H
+
+/* mkprefix lives in here rather than in libssss.c so that bench.c can get
+ * at it in isolation, while staying inlineable into prepend_lines */
+
+#include <stddef.h>
+
+#include "libssss.h"
+#include "timestamp.h"
+
+#include "compat/inline-restrict.h"
+#include "compat/__attribute__.h"
+
+static __inline__ size_t __attribute__((nonnull, __access__(write_only, 3)))
+mkprefix(const unsigned char flags, const int fd, char prefixbuf[TIMESTAMP_SIZE + 3])
+/* Based on flags and fd, writes a prefix to prefixbuf that should prefix
+ * each buffalo in buffalo, eg. `[21:34:56.135429]&1 '. Returns the length
+ * of the string written to prefixbuf, not including any terminating NUL if
+ * there is one, WHICH THERE MAY NOT BE. Do NOT rely on the string written
+ * to prefixbuf being NUL-terminated!
+ *
+ * Fair warning: this function is hyper-optimised
+ *
+ * The goto is to ensure that (flags & FLAG_PREFIX) is only tested once
+ * Think of it like
+ *	if (flags & FLAG_TIMESTAMPS && flags & FLAG_PREFIX)
+ *		...
+ *	else if (flags & FLAG_TIMESTAMPS)
+ *		...
+ *	else if (flags & FLAG_PREFIX)
+ *		...
+ * but marginally less mank
+ *
+ * TODO: a small thing, but we don't need to keep rechecking flags */
+{
+	size_t i = 0;
+
+	if (flags & FLAG_TIMESTAMPS) {
+		sprint_time(prefixbuf);
+		if (flags & FLAG_PREFIX) {
+			i += TIMESTAMP_SIZE - 2;
+			/* Overwrite trailing ^ space and NUL */
+			goto prefix;
+		} else
+			/* Don't include trailing NUL in return value */
+			return TIMESTAMP_SIZE - 1;
+	}
+
+	if (flags & FLAG_PREFIX)
+prefix:		prefixbuf[i++] = '&', prefixbuf[i++] = fd + '0', /* Assumes
+		* that fd < 10; if it isn't, then we're into punctuation */
+		prefixbuf[i++] = ' ';
+
+	return i;
+}
+
+#endif /* PREFIX_H */
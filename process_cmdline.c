@@ -3,8 +3,10 @@
 #include "config.h" /* Must be before any other includes or test macros */
 
 #include  <stdio.h> /* puts(3), printf(3), fprintf(3) */
-#include <stdlib.h> /* exit(3) */
-#include <string.h> /* strcmp(3) */
+#include <signal.h> /* SIG* */
+#include <stdlib.h> /* exit(3), strtod(3), strtoul(3), getsubopt(3) */
+#include <string.h> /* strcmp(3), strspn(3) */
+#include <sys/stat.h> /* fstat(2) */
 #include <unistd.h> /* isatty(3), getopt(3) */
 
 #include "process_cmdline.h"
@@ -32,32 +34,109 @@ usage(const char *__restrict__ const progname)
 {
 	static const char help[] = "\
 Usage: %s [OPT(s)] PROG [PROGARG(s)]\n\
+   or: %s --attach NAME [OPT(s)]\n\
+   or: %s --serve SOCKET [OPT(s)]\n\
 Runs PROG with PROGARG(s) if any, and marks which of the output is stdout\n\
-and which is stderr. Returns PROG's exit status\n\
+and which is stderr. Returns PROG's exit status. Or, watches the output of\n\
+another ssss -T NAME, formatted as OPT(s) say. Or, stays up and does the\n\
+same for every `ssss-run SOCKET PROG' there is, till SIGINT or SIGTERM;\n\
+only -[12cgjpqStvCGP] and -d count, and -c and -p go by this terminal\n\
 \n\
 Options:\n\
 	-1	Output everything to one stream, stdout. Equivalent of piping\n\
 		through |& in bash\n\
-	-2	Output PROG's stdout->stdout and stderr->stderr (default)\n\
+	-2	Output PROG's stdout->stdout and stderr->stderr (default,\n\
+		unless they're the same file anyway, when it's -1; give -2\n\
+		to keep them apart all the same)\n\
 	-A OPTS	Set any applicable option characters in OPTS (/(?i)[cp]/) to\n\
 		auto-detect their values (ie. default settings)\n\
+	-b	Keep a status line at the bottom of the terminal, with\n\
+		PROG's pid, how long it's been going, and each stream's\n\
+		bytes and lines a second and how long since it last said\n\
+		anything. Only if stdout is a terminal\n\
 	-c	Colour output (default: if output isatty(3))\n\
 	-C	Turn off -c\n\
+	-d SECS	Once PROG has exited, wait at most SECS (default 1) for\n\
+		the rest of its output, in case something it's left running\n\
+		still has hold of it\n\
+	-g SECS	Keep lines that continue the one before (that start with\n\
+		whitespace or a -G PREFIX) together with it, with one prefix\n\
+		and nothing from the other stream in between, as for a stack\n\
+		trace; holding the last of them for at most SECS, in case\n\
+		more are coming\n\
+	-G PREFIX\n\
+		For -g: lines starting with PREFIX (eg. `Caused by:') also\n\
+		continue the one before. Repeatable\n\
+	-i [FD:]SECS\n\
+		If PROG's FD (1 or 2; default both) says nothing for SECS\n\
+		(may be fractional), say so on stderr, with a timestamp.\n\
+		Repeatable\n\
+	-j	Output each line as a JSON object of its stream, the time\n\
+		and a sequence number (see libssss.h), for machines.\n\
+		-[cpS] are ignored\n\
+	-k [SIG:]SECS\n\
+		If PROG says nothing at all for SECS, send it SIG (a name\n\
+		or number; default TERM), and if it's quiet that long again,\n\
+		KILL\n\
+	-l [FD:]PATH\n\
+		Also append PROG's FD (1 or 2; default both, in the one\n\
+		file) to PATH, timestamped. Repeatable\n\
+	-L size=BYTES[KMG],age=SECS,sync=SECS,keep=N,compress\n\
+		For -l: rotate to PATH.1, PATH.2, ... PATH.N (default 5)\n\
+		past BYTES or SECS, and write out and sync every SECS\n\
+		(default 1) rather than every line; compress, on a thread\n\
+		of its own, for ssss-unz to read back (BYTES is then of\n\
+		the compressed file, and it's whole blocks, 256K, that\n\
+		are synced). Any or all of them\n\
+	-o [MODE:]PATH\n\
+		Also append PROG's output to PATH (a file, or a FIFO\n\
+		that's being read), both streams in one, formatted as MODE\n\
+		says: any of the letters cjpSt, as for those options, and\n\
+		just p if not given. Each read is formatted once per MODE,\n\
+		and if PATH is too slow to keep up, its output is dropped\n\
+		rather than holding anything else up. Repeatable\n\
+	-m SECS, --max-latency=SECS\n\
+		Rather than writing out each lot of PROG's output as soon as\n\
+		it's read, save it up, across both streams, till there's a\n\
+		buffer's worth or the oldest of it's been waiting SECS (or\n\
+		with ms after it, milliseconds; eg. 5ms). Fewer, bigger\n\
+		writes, for the price of the wait. On a terminal, it's let\n\
+		out as soon as PROG's got no more to say for now\n\
+	-M PATH	Serve live counters on an AF_UNIX socket at PATH, in the\n\
+		Prometheus text format; one snapshot per connection\n\
 	-p	Prefix lines with the fd whence they came (default: if\n\
 		output isn't coloured)\n\
 	-P	Turn off -p\n\
+	-R ADDR	Also send each line to a collector at ADDR (HOST:PORT, or\n\
+		a path to a Unix socket), as length-prefixed records of\n\
+		stream, timestamp and line; see remote.h\n\
 	-S	Print streams side-by-side, (bit of a WIP). Note that -[12Pp]\n\
 		are (mostly) silently ignored if this flag is passed. Note\n\
 		also that $COLUMNS is respected if ssss can't get window size\n\
 		from the terminal\n\
 	-t	Add timestamps\n\
+	-T NAME	Publish PROG's output in shared memory as NAME, for\n\
+		`ssss --attach NAME' to watch from elsewhere. Whoever's\n\
+		watching can't slow PROG or us down; if they fall behind,\n\
+		they miss some, and are told so\n\
+	-u	When PROG exits, report its CPU time, max RSS and context\n\
+		switches, and with -v, ssss' own alongside\n\
+	-U	Like -u, but as one machine-readable line of key=value\n\
 	-q	Quiet -- don't print anything of our own, just get busy\n\
 		transforming the output of PROG\n\
 	-v	Verbose -- print more\n\
+	-w [FD:]WEIGHT\n\
+		When both of PROG's streams are busy, take WEIGHT (1 to\n\
+		1000; default 1) times as much at a time from FD (1 or 2;\n\
+		default both) before turning to the other. Repeatable\n\
+	-X PATH	Pass PROG's output through byte for byte, and index it in\n\
+		PATH: where each read of it went, how much, from which\n\
+		stream and when, for ssss-index to filter or annotate by\n\
+		later (see sidecar.h). -[cgjpStG] are ignored\n\
 	--help, -h	Print this help and exit\n\
 	--version, -V	Print version information and exit\n";
 
-	printf(help, progname);
+	printf(help, progname, progname, progname);
 	exit(EXIT_SUCCESS);
 }
 
@@ -83,6 +162,8 @@ longopt_help_version(char *const *const argv)
 		version();
 }
 
+struct opts opts;
+
 extern char ** environ;
 
 static bool
@@ -110,6 +191,13 @@ do_colour(const unsigned char flags)
 		}
 	}
 
+	/* --serve's own stdout isn't where anything goes; it's for each
+	 * ssss-run's to say, as it comes in */
+	if (opts.serve_path) {
+		opts.serve_colour = 1;
+		return false;
+	}
+
 	return	isatty(STDOUT_FILENO)
 		? flags & FLAG_ALLINONE
 			? true
@@ -117,26 +205,274 @@ do_colour(const unsigned char flags)
 		: false;
 }
 
+static bool
+same_output(void)
+/* Whether stdout and stderr are the one file, terminal or pipe, as they
+ * usually are. Then there's nothing to tell -2 from -1 but that -2 writes
+ * them in two lots, and they can get to it in either order */
+{
+	struct stat out, err;
+	return fstat(STDOUT_FILENO, &out) == 0 && fstat(STDERR_FILENO, &err) == 0
+		&& out.st_dev == err.st_dev && out.st_ino == err.st_ino;
+}
+
+static long
+parse_secs(const char *__restrict__ const progname, const int o,
+		const char *__restrict__ const arg)
+/* For -d, -i and the like: seconds, as ms */
+{
+	char *end;
+	const double secs = strtod(arg, &end);
+	if (end == arg || *end || !(secs > 0 && secs < 1e6)) {
+		fprintf(stderr, "%s: -%c: invalid number of seconds: %s\n",
+			progname, o, arg);
+		exit(-1);
+	}
+	return (long)(secs * 1000 + 0.5);
+}
+
+static long
+parse_latency(const char *__restrict__ const progname,
+		const char *__restrict__ const arg)
+/* For -m: seconds, or milliseconds with `ms' after, as ms; at least 1 */
+{
+	char *end;
+	double secs = strtod(arg, &end);
+	if (strcmp(end, "ms") == 0)
+		secs /= 1000;
+	else if (*end && strcmp(end, "s") != 0)
+		end = (char *)arg;
+	if (end == arg || !(secs > 0 && secs < 1e6)) {
+		fprintf(stderr, "%s: --max-latency: invalid latency: %s\n",
+			progname, arg);
+		exit(-1);
+	}
+	return secs < 0.001 ? 1 : (long)(secs * 1000 + 0.5);
+}
+
+static void
+parse_idle(const char *__restrict__ const progname, const char *__restrict__ arg)
+{
+	int fd = 0; /* both */
+
+	if ((arg[0] == '1' || arg[0] == '2') && arg[1] == ':')
+		fd = arg[0] - '0', arg += 2;
+
+	if (fd != 2) opts.idle_ms[0] = parse_secs(progname, 'i', arg);
+	if (fd != 1) opts.idle_ms[1] = parse_secs(progname, 'i', arg);
+}
+
+static void
+parse_kill(const char *__restrict__ const progname, const char *__restrict__ arg)
+{
+	/* Only the ones anyone would want to send to a hung process */
+	static const struct { char name[5]; int sig; } signals[] = {
+		{ "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT },
+		{ "ABRT", SIGABRT }, { "KILL", SIGKILL }, { "USR1", SIGUSR1 },
+		{ "USR2", SIGUSR2 }, { "ALRM", SIGALRM }, { "TERM", SIGTERM }
+	};
+	const char *const colon = strchr(arg, ':');
+
+	opts.kill_sig = SIGTERM;
+	if (colon) {
+		const char *name = arg;
+		size_t i;
+
+		if (strncmp(name, "SIG", 3) == 0)
+			name += 3;
+		if (*name >= '0' && *name <= '9')
+			opts.kill_sig = atoi(name);
+		else {
+			for (i = 0; i < sizeof signals / sizeof *signals; i++)
+				if (strncmp(name, signals[i].name, colon - name) == 0
+				    && !signals[i].name[colon - name])
+					break;
+			if (i == sizeof signals / sizeof *signals) {
+				fprintf(stderr, "%s: -k: unknown signal: %.*s\n",
+					progname, (int)(colon - arg), arg);
+				exit(-1);
+			}
+			opts.kill_sig = signals[i].sig;
+		}
+		arg = colon + 1;
+	}
+
+	opts.kill_ms = parse_secs(progname, 'k', arg);
+}
+
+static void
+add_group_prefix(const int argc, const char *__restrict__ const progname,
+		const char *__restrict__ const prefix)
+{
+	size_t i = 0;
+
+	/* There can't be more of them than there are args */
+	if (!opts.group_prefixes
+	    && !(opts.group_prefixes = calloc(argc, sizeof *opts.group_prefixes)))
+	{
+		perror(progname);
+		exit(-1);
+	}
+	while (opts.group_prefixes[i])
+		i++;
+	opts.group_prefixes[i] = prefix;
+}
+
+static void
+parse_weight(const char *__restrict__ const progname, const char *__restrict__ arg)
+{
+	int fd = 0, weight; /* both */
+	char *end;
+
+	if ((arg[0] == '1' || arg[0] == '2') && arg[1] == ':')
+		fd = arg[0] - '0', arg += 2;
+
+	weight = (int)strtol(arg, &end, 10);
+	if (end == arg || *end || weight < 1 || weight > 1000) {
+		fprintf(stderr, "%s: -w: weight must be from 1 to 1000: %s\n",
+			progname, arg);
+		exit(-1);
+	}
+
+	if (fd != 2) opts.weight[0] = weight;
+	if (fd != 1) opts.weight[1] = weight;
+}
+
+static void
+add_sink(const int argc, const char *__restrict__ const progname,
+		const char *__restrict__ arg)
+{
+	const char *const colon = strchr(arg, ':');
+	unsigned char flags = FLAG_PREFIX;
+
+	/* Only a MODE if it looks like one, else it's all PATH */
+	if (colon && strspn(arg, "cjpSt") == (size_t)(colon - arg)) {
+		for (flags = 0; arg < colon; arg++)
+			switch (*arg) {
+			case 'c':	flags |= FLAG_COLOUR; break;
+			case 'j':	flags |= FLAG_JSON; break;
+			case 'p':	flags |= FLAG_PREFIX; break;
+			case 'S':	flags |= FLAG_COLUMNS; break;
+			case 't':	flags |= FLAG_TIMESTAMPS; break;
+			}
+		arg++;
+	}
+	if (!*arg) {
+		fprintf(stderr, "%s: -o: no PATH\n", progname);
+		exit(-1);
+	}
+	if (flags & FLAG_JSON)
+		flags &= ~FLAG_COLOUR; /* as for -j */
+
+	/* There can't be more of them than there are args */
+	if (!opts.sinks && !(opts.sinks = calloc(argc, sizeof *opts.sinks))) {
+		perror(progname);
+		exit(-1);
+	}
+	opts.sinks[opts.nsinks].path = arg;
+	opts.sinks[opts.nsinks++].flags = flags | FLAG_ALLINONE;
+}
+
+static void
+parse_log(const char *__restrict__ const arg)
+{
+	if ((arg[0] == '1' || arg[0] == '2') && arg[1] == ':')
+		opts.log_path[arg[0] - '1'] = arg + 2;
+	else
+		opts.log_path[0] = opts.log_path[1] = arg;
+}
+
+static void
+parse_rotation(const char *__restrict__ const progname, char *arg)
+{
+	enum { SIZE, AGE, SYNC, KEEP, COMPRESS };
+	static char *const keys[] = { "size", "age", "sync", "keep", "compress", NULL };
+
+	while (*arg) {
+		char *val, *end;
+		const int key = getsubopt(&arg, keys, &val);
+
+		if (key == COMPRESS && !val) {
+			opts.log.compress = 1;
+			continue;
+		}
+		if (key == -1 || !val) {
+			fprintf(stderr, "%s: -L: expected size=, age=, sync=, keep= or compress: %s\n",
+				progname, val ? val : "");
+			exit(-1);
+		}
+		switch (key) {
+		case SIZE:
+			opts.log.size = strtoul(val, &end, 10);
+			switch (*end) {
+			case 'G': case 'g': opts.log.size <<= 10; /*@fallthrough@*/
+			case 'M': case 'm': opts.log.size <<= 10; /*@fallthrough@*/
+			case 'K': case 'k': opts.log.size <<= 10; end++;
+			}
+			if (end == val || *end || !opts.log.size) {
+				fprintf(stderr, "%s: -L: invalid size: %s\n", progname, val);
+				exit(-1);
+			}
+			break;
+		case AGE:	opts.log.age_ms = parse_secs(progname, 'L', val); break;
+		case SYNC:	opts.log.sync_ms = parse_secs(progname, 'L', val); break;
+		case KEEP:
+			opts.log.keep = atoi(val);
+			if (opts.log.keep < 1) {
+				fprintf(stderr, "%s: -L: keep must be at least 1: %s\n",
+					progname, val);
+				exit(-1);
+			}
+			break;
+		case COMPRESS:
+			fprintf(stderr, "%s: -L: compress is just compress, not compress=%s\n",
+				progname, val);
+			exit(-1);
+		}
+	}
+}
+
 extern unsigned char
 process_cmdline(const int argc, char *const *const argv)
 {
-	static const char optstr[] = "+12A:CPSVchpqtv";
+	static const char optstr[] = "+12A:CG:L:M:PR:ST:UVX:bcd:g:hi:jk:l:m:o:pqtuvw:-:";
 	/* The + at the beginning is  ^ for GNU getopt(3), to let us pass
-	 * options to PROG (else it permutes them away to us) */
+	 * options to PROG (else it permutes them away to us). The -: at the
+	 * end is for --long=options, which getopt(3) takes to be -- with
+	 * long=options for its argument */
 
 	unsigned char flags = 0;
-	enum { ON, OFF, AUTO } colour = AUTO, prefix = AUTO;
+	enum { ON, OFF, AUTO } colour = AUTO, prefix = AUTO, streams = AUTO;
 
 	/* hacky support for --help and --version */
 	if (argv[1] && argv[1][0] == '-')
 		longopt_help_version(argv);
 
+	/* ssss --attach NAME [OPT(s)]: there's no PROG, just someone
+	 * else's */
+	if (argv[1] && strcmp(argv[1], "--attach") == 0) {
+		if (!(opts.attach = argv[2])) {
+			fprintf(stderr, "%s: --attach: attach to what?\n", argv[0]);
+			exit(-1);
+		}
+		optind = 3;
+	}
+
+	/* ssss --serve SOCKET [OPT(s)]: no PROG either, just ssss-run's */
+	if (argv[1] && strcmp(argv[1], "--serve") == 0) {
+		if (!(opts.serve_path = argv[2])) {
+			fprintf(stderr, "%s: --serve: serve where?\n", argv[0]);
+			exit(-1);
+		}
+		optind = 3;
+	}
+
 	for (;;) {
 		const int o = getopt(argc, argv, optstr);
 		if (o == -1) break;
 		switch (o) {
-		case '1':	flags |=  FLAG_ALLINONE; break;
-		case '2':	flags &= ~FLAG_ALLINONE; break;
+		case '1':	flags |=  FLAG_ALLINONE; streams = ON;  break;
+		case '2':	flags &= ~FLAG_ALLINONE; streams = OFF; break;
 		case 'A':
 			for (; *optarg; optarg++)
 				switch (*optarg) {
@@ -148,15 +484,40 @@ process_cmdline(const int argc, char *const *const argv)
 				}
 			break;
 		case 'C':	colour = OFF; break;
+		case 'G':	add_group_prefix(argc, *argv, optarg); break;
+		case 'L':	parse_rotation(*argv, optarg); break;
+		case 'M':	opts.metrics_path = optarg; break;
 		case 'P':	prefix = OFF; break;
+		case 'R':	opts.remote_addr = optarg; break;
 		case 'S':	flags |= FLAG_COLUMNS; break;
+		case 'T':	opts.tail_name = optarg; break;
+		case 'U':	opts.rusage = REPORT_MACHINE; break;
 		case 'V':	version();
+		case 'X':	opts.index_path = optarg; break;
+		case 'b':	opts.status_line = 1; break;
 		case 'c':	colour = ON;  break;
+		case 'd':	opts.drain_ms = parse_secs(*argv, 'd', optarg); break;
+		case 'g':	opts.group_ms = parse_secs(*argv, 'g', optarg); break;
 		case 'h':	usage(argv[0]);
+		case 'i':	parse_idle(*argv, optarg); break;
+		case 'j':	flags |= FLAG_JSON; break;
+		case 'k':	parse_kill(*argv, optarg); break;
+		case 'l':	parse_log(optarg); break;
+		case 'm':	opts.latency_ms = parse_latency(*argv, optarg); break;
+		case 'o':	add_sink(argc, *argv, optarg); break;
 		case 'p':	prefix = ON;  break;
 		case 'q':	flags |= FLAG_QUIET; break;
 		case 't': 	flags |= FLAG_TIMESTAMPS; break;
+		case 'u':	opts.rusage = REPORT_HUMAN; break;
 		case 'v':	flags |= FLAG_VERBOSE; break;
+		case 'w':	parse_weight(*argv, optarg); break;
+		case '-':
+			if (strncmp(optarg, "max-latency=", 12) == 0) {
+				opts.latency_ms = parse_latency(*argv, optarg + 12);
+				break;
+			}
+			fprintf(stderr, "%s: invalid option -- -%s\n", *argv, optarg);
+			exit(-1);
 
 #ifndef __GLIBC__
 		case '+':
@@ -170,7 +531,7 @@ process_cmdline(const int argc, char *const *const argv)
 		}
 	}
 
-	if (argc - optind == 0) {
+	if (argc - optind == 0 && !opts.attach && !opts.serve_path) {
 		fprintf(stderr, "%s: not enough arguments\n", argv[0]);
 		exit(-1);
 	}
@@ -191,6 +552,37 @@ process_cmdline(const int argc, char *const *const argv)
 	 * statement just to begin to understand this kind of shit but
 	 * *there is no null statement*, that's the fucking point! I'm going
 	 * places the compiler can't follow! */
+	/* The index is of the output byte for byte as PROG wrote it, so
+	 * nothing of ours can go in it, nor can it be held back and
+	 * shuffled by -g */
+	if (opts.index_path) {
+		flags &= ~(FLAG_TIMESTAMPS | FLAG_JSON | FLAG_COLUMNS);
+		colour = prefix = OFF;
+		opts.group_ms = 0;
+	}
+
+	/* The status line's escapes are for a terminal, and it has to be the
+	 * terminal to know where its bottom is */
+	if (opts.status_line && !isatty(STDOUT_FILENO)) {
+		if (~flags & FLAG_QUIET)
+			fprintf(stderr, "%s: -b: stdout isn't a terminal; no status line\n",
+				argv[0]);
+		opts.status_line = 0;
+	}
+
+	/* One buffer, in the order it was read, and one write(2) of it at a
+	 * time, unless -2 says otherwise. -S has a mind of its own about
+	 * where things go. Not for --serve, whose stdout and stderr aren't
+	 * where anything goes */
+	if (streams == AUTO && ~flags & FLAG_COLUMNS && !opts.serve_path
+	    && same_output())
+		flags |= FLAG_ALLINONE;
+
+	/* No escapes in the JSON, thanks; and no -p or -S either, but that's
+	 * up to the formatter */
+	if (flags & FLAG_JSON)
+		colour = OFF;
+
 	switch (colour) {
 	case AUTO:
 		if (do_colour(flags))
@@ -3,26 +3,44 @@
 #ifndef PROCESS_CMDLINE_H
 #define PROCESS_CMDLINE_H
 
+#include "libssss.h" /* FLAG_* */
+
 #include "compat/__attribute__.h"
 
-/* Flag constants -- used to be macros, but it's useful to have them typed
- * just in case */
-#if __STDC_VERSION__ >= 202300L
-enum : unsigned char {
-#else
-static const unsigned char
-#endif /* C23 */
-	FLAG_ALLINONE	= 1 << 0,
-	FLAG_TIMESTAMPS	= 1 << 1,
-	FLAG_COLOUR	= 1 << 2,
-	FLAG_PREFIX	= 1 << 3,
-	FLAG_VERBOSE	= 1 << 4,
-	FLAG_QUIET	= 1 << 5,
-	FLAG_COLUMNS	= 1 << 6
-#if __STDC_VERSION__ >= 202300L
-}
-#endif /* C23 */
-	;
+/* Options that take an argument. Zeroed unless given on the command line */
+extern struct opts {
+	const char *metrics_path;	/* -M */
+	const char *remote_addr;	/* -R */
+	const char *index_path;		/* -X */
+	const char *tail_name;		/* -T */
+	const char *attach;		/* --attach */
+	const char *serve_path;		/* --serve */
+	int serve_colour;		/* and no -c or -C, nor NO_COLOR: as
+					 * each ssss-run's terminal says */
+	struct sink_opts {
+		const char *path;
+		unsigned char flags;	/* FLAG_ALLINONE and all */
+	} *sinks;			/* -o */
+	int nsinks;
+	int status_line;		/* -b */
+	enum { REPORT_NONE, REPORT_HUMAN, REPORT_MACHINE } rusage; /* -u, -U */
+	long idle_ms[2];		/* -i, by fd - 1 */
+	long kill_ms;			/* -k */
+	int kill_sig;
+	long drain_ms;			/* -d */
+	long latency_ms;		/* -m, --max-latency */
+	long group_ms;			/* -g */
+	const char **group_prefixes;	/* -G, NULL-terminated */
+	int weight[2];			/* -w, by fd - 1; 0 for 1 */
+	const char *log_path[2];	/* -l, by fd - 1; the same for both
+					 * if they're to be in one file */
+	struct {
+		unsigned long size;	/* 0 for no limit */
+		long age_ms, sync_ms;
+		int keep;
+		int compress;
+	} log;				/* -L */
+} opts;
 
 extern unsigned char process_cmdline(const int argc, char *const * argv) __attribute__((leaf));
 
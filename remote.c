@@ -0,0 +1,429 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>	/* realloc(3), free(3) */
+#include <string.h>	/* memchr(3), memcpy(3), memmove(3), strrchr(3) */
+
+#include <err.h>
+#include <fcntl.h>
+#include <netdb.h>	/* getaddrinfo(3) */
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "metrics.h"
+#include "remote.h"
+#include "timestamp.h"
+
+#include "compat/bool.h"
+#include "compat/inline-restrict.h"
+#include "compat/__attribute__.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 /* see SO_NOSIGPIPE below */
+#endif
+
+#define HEADER_SIZE	(4 + 1 + 8)
+#define MAX_LINE	(64 * 1024)	/* longer lines are split */
+#define BATCH		(32 * 1024)	/* bytes to send at once */
+#define DEADLINE_MS	200		/* or after this long */
+#define BACKLOG		(4 * 1024 * 1024) /* records past this are dropped */
+#define RETRY_MIN_MS	500
+#define RETRY_MAX_MS	30000
+
+static struct {
+	struct addrinfo *ai;	/* from getaddrinfo(3), or: */
+	union {
+		struct sockaddr sa;
+		struct sockaddr_un un;
+	} sun;			/* ...if ai is NULL */
+	const char *addr;	/* for messages */
+
+	int fd;
+	enum { DOWN, CONNECTING, UP } state;
+	uint64_t retry_at;	/* monotonic ns, if DOWN */
+	long retry_ms;		/* next backoff */
+
+	/* The backlog: buf[head..len) is unsent, and buf[frame..head) is
+	 * the start of a record that's only partly sent, which will have to
+	 * be sent again from the top if the connection drops */
+	char *buf;
+	size_t cap, len, head, frame;
+	uint64_t oldest;	/* monotonic ns the oldest unsent record was queued */
+	unsigned long dropped;
+
+	/* Lines not yet finished, by fd - 1 */
+	struct partial {
+		char *buf;
+		size_t len;
+		uint64_t when;	/* realtime ns it started */
+	} partial[2];
+
+	bool finishing;		/* send everything, batch or no batch */
+} remote = { NULL };
+
+static __inline__ void
+put_be(char *p, uint64_t x, int n)
+{
+	while (n--)
+		p[n] = x & 0xff, x >>= 8;
+}
+
+static void
+backlog_reserve(const size_t n)
+{
+	if (remote.cap - remote.len >= n)
+		return;
+
+	/* Make room by discarding what's sent first */
+	if (remote.frame) {
+		memmove(remote.buf, remote.buf + remote.frame, remote.len - remote.frame);
+		remote.len -= remote.frame;
+		remote.head -= remote.frame;
+		remote.frame = 0;
+	}
+
+	while (remote.cap - remote.len < n)
+		remote.cap = remote.cap ? remote.cap * 2 : BATCH * 2;
+	remote.buf = realloc(remote.buf, remote.cap);
+	if (!remote.buf)
+		err(-1, NULL);
+}
+
+static void __attribute__((nonnull(5)))
+record(const int fd, const uint64_t when, const char *const a, const size_t an,
+	const char *const b, const size_t bn)
+/* Queue one record of a and b, a possibly being a partial line from
+ * before and b the end of it */
+{
+	const size_t n = HEADER_SIZE + an + bn;
+	char *p;
+
+	if (remote.len - remote.frame + n > BACKLOG) {
+		remote.dropped++;
+		metrics.remote_dropped = remote.dropped;
+		return;
+	}
+
+	backlog_reserve(n);
+	if (remote.head == remote.len)
+		remote.oldest = monotonic_ns();
+
+	p = remote.buf + remote.len;
+	put_be(p, n - 4, 4);
+	p[4] = fd;
+	put_be(p + 5, when, 8);
+	if (an)
+		memcpy(p + HEADER_SIZE, a, an);
+	memcpy(p + HEADER_SIZE + an, b, bn);
+	remote.len += n;
+
+	metrics.remote_backlog = remote.len - remote.frame;
+}
+
+extern void __attribute__((nonnull, __access__(read_only, 2, 3)))
+remote_feed(const int fd, const char *buf, size_t n)
+/* Split into lines, finishing any partial line from last time */
+{
+	const uint64_t now = realtime_ns();
+
+	while (n) {
+		const char *const nl = memchr(buf, '\n', n);
+		size_t k = nl ? (size_t)(nl - buf) : n;
+		struct partial *const part = &remote.partial[fd - 1];
+
+		if (!part->len && nl) {
+			/* The usual case: a whole line, no copying. Unless
+			 * it's too long, and then as much of it as will go,
+			 * and the rest round again */
+			if (k > MAX_LINE)
+				k = MAX_LINE;
+			record(fd, now, NULL, 0, buf, k);
+		} else {
+			if (!part->len)
+				part->when = now;
+			if (part->len + k > MAX_LINE)
+				k = MAX_LINE - part->len;
+			if (!part->buf && !(part->buf = malloc(MAX_LINE)))
+				err(-1, NULL);
+			memcpy(part->buf + part->len, buf, k);
+			part->len += k;
+
+			if ((nl && buf + k == nl) || part->len == MAX_LINE) {
+				record(fd, part->when, part->buf, part->len, buf, 0);
+				part->len = 0;
+			}
+		}
+
+		if (nl && buf + k == nl)
+			k++; /* the newline */
+		buf += k, n -= k;
+	}
+}
+
+static void
+go_down(const char *const why)
+{
+	if (why)
+		warn("%s: %s", remote.addr, why);
+	if (remote.fd != -1)
+		close(remote.fd);
+	remote.fd = -1;
+	remote.state = DOWN;
+	remote.retry_at = monotonic_ns() + (uint64_t)remote.retry_ms * NS_PER_MS;
+	remote.retry_ms *= 2;
+	if (remote.retry_ms > RETRY_MAX_MS)
+		remote.retry_ms = RETRY_MAX_MS;
+
+	/* Whatever was half-sent will be sent again, whole */
+	remote.head = remote.frame;
+	metrics.remote_up = 0;
+}
+
+static void
+go_up(void)
+{
+	remote.state = UP;
+	remote.retry_ms = RETRY_MIN_MS;
+	metrics.remote_up = 1;
+}
+
+static void
+try_connect(void)
+{
+	const struct sockaddr *sa;
+	socklen_t salen;
+	int family;
+
+	if (remote.ai)
+		family = remote.ai->ai_family, sa = remote.ai->ai_addr,
+		salen = remote.ai->ai_addrlen;
+	else
+		family = AF_UNIX, sa = &remote.sun.sa,
+		salen = sizeof remote.sun.un;
+
+	remote.fd = socket(family, SOCK_STREAM, 0);
+	if (remote.fd >= FD_SETSIZE)
+		errno = EMFILE; /* as far as select(2)'s concerned */
+	if (remote.fd == -1 || remote.fd >= FD_SETSIZE) {
+		go_down("socket(2)");
+		return;
+	}
+	fcntl(remote.fd, F_SETFL, O_NONBLOCK);
+	fcntl(remote.fd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+	{
+		const int one = 1;
+		setsockopt(remote.fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof one);
+	}
+#endif
+
+	if (connect(remote.fd, sa, salen) == 0)
+		go_up();
+	else if (errno == EINPROGRESS)
+		remote.state = CONNECTING;
+	else
+		/* Quietly: it'll be retried, and the collector not being
+		 * there yet is nothing to shout about every time */
+		go_down(NULL);
+}
+
+extern void __attribute__((nonnull))
+remote_open(const char *const addr)
+{
+	remote.addr = addr;
+	remote.fd = -1;
+	metrics.remote_up = 0;
+	remote.retry_ms = RETRY_MIN_MS;
+
+	if (strchr(addr, '/')) {
+		if (strlen(addr) >= sizeof remote.sun.un.sun_path)
+			errx(-1, "%s: socket path too long", addr);
+		remote.sun.un.sun_family = AF_UNIX;
+		strcpy(remote.sun.un.sun_path, addr);
+	} else {
+		struct addrinfo hints;
+		const char *const colon = strrchr(addr, ':');
+		char *host;
+		int e;
+
+		if (!colon)
+			errx(-1, "%s: expected HOST:PORT or a path", addr);
+		host = malloc(colon - addr + 1);
+		if (!host)
+			err(-1, NULL);
+		memcpy(host, addr, colon - addr);
+		host[colon - addr] = '\0';
+
+		memset(&hints, 0, sizeof hints);
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		/* Once, up front: a blocking lookup mid-stream would stall
+		 * everything */
+		if ((e = getaddrinfo(host, colon + 1, &hints, &remote.ai)) != 0)
+			errx(-1, "%s: %s", addr, gai_strerror(e));
+		free(host);
+	}
+
+	try_connect();
+}
+
+static __inline__ bool
+want_send(void)
+{
+	return remote.head < remote.len
+		&& (remote.finishing || remote.len - remote.head >= BATCH
+		    || ms_until(remote.oldest + (uint64_t)DEADLINE_MS * NS_PER_MS) == 0);
+}
+
+extern long __attribute__((nonnull))
+remote_prepare(fd_set *const r, fd_set *const w, int *const fdsn)
+{
+	switch (remote.state) {
+	case DOWN:
+		return ms_until(remote.retry_at);
+
+	case CONNECTING:
+		FD_SET(remote.fd, w);
+		if (remote.fd >= *fdsn)
+			*fdsn = remote.fd + 1;
+		return -1;
+
+	case UP:
+		/* Only ever read to notice it hanging up */
+		FD_SET(remote.fd, r);
+		if (remote.fd >= *fdsn)
+			*fdsn = remote.fd + 1;
+		if (want_send()) {
+			FD_SET(remote.fd, w);
+			return -1;
+		}
+		return remote.head < remote.len
+			? ms_until(remote.oldest + (uint64_t)DEADLINE_MS * NS_PER_MS)
+			: -1;
+	}
+
+	return -1;
+}
+
+static void
+send_backlog(void)
+{
+	while (remote.head < remote.len) {
+		const ssize_t n = send(remote.fd, remote.buf + remote.head,
+			remote.len - remote.head, MSG_NOSIGNAL);
+		if (n == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				break;
+			go_down("send(2)");
+			return;
+		}
+		remote.head += n;
+	}
+
+	/* Move frame up to the record head is in the middle of */
+	while (remote.frame < remote.head) {
+		const unsigned char *const p = (unsigned char *)remote.buf + remote.frame;
+		const size_t n = 4 + ((size_t)p[0] << 24 | (size_t)p[1] << 16
+			| (size_t)p[2] << 8 | p[3]);
+		if (remote.frame + n > remote.head)
+			break;
+		remote.frame += n;
+	}
+
+	if (remote.frame == remote.len)
+		remote.frame = remote.head = remote.len = 0;
+	else if (remote.head < remote.len)
+		remote.oldest = monotonic_ns();
+
+	metrics.remote_backlog = remote.len - remote.frame;
+}
+
+extern void __attribute__((nonnull))
+remote_service(const fd_set *const r, const fd_set *const w)
+{
+	switch (remote.state) {
+	case DOWN:
+		if (ms_until(remote.retry_at) == 0)
+			try_connect();
+		break;
+
+	case CONNECTING:
+		if (FD_ISSET(remote.fd, w)) {
+			int e = 0;
+			socklen_t elen = sizeof e;
+			getsockopt(remote.fd, SOL_SOCKET, SO_ERROR, &e, &elen);
+			if (e == 0)
+				go_up();
+			else
+				go_down(NULL);
+		}
+		break;
+
+	case UP:
+		if (FD_ISSET(remote.fd, r)) {
+			char junk[512];
+			const ssize_t n = recv(remote.fd, junk, sizeof junk, 0);
+			if (n == 0 || (n == -1 && errno != EAGAIN && errno != EINTR)) {
+				go_down(n ? "recv(2)" : NULL);
+				break;
+			}
+		}
+		if (FD_ISSET(remote.fd, w))
+			send_backlog();
+	}
+}
+
+extern void
+remote_finish(const long timeout_ms, const bool quiet)
+{
+	const uint64_t give_up = monotonic_ns() + (uint64_t)timeout_ms * NS_PER_MS;
+	int i;
+
+	for (i = 0; i < 2; i++)
+		if (remote.partial[i].len) {
+			record(i + 1, remote.partial[i].when,
+				remote.partial[i].buf, remote.partial[i].len, "", 0);
+			remote.partial[i].len = 0;
+		}
+
+	remote.finishing = true;
+	while (remote.head < remote.len && ms_until(give_up)) {
+		fd_set r, w;
+		struct timeval tv;
+		long ms = ms_until(give_up), wait;
+		int fdsn = 1;
+
+		FD_ZERO(&r);
+		FD_ZERO(&w);
+		wait = remote_prepare(&r, &w, &fdsn);
+		if (wait != -1 && wait < ms)
+			ms = wait;
+		tv.tv_sec = ms / 1000;
+		tv.tv_usec = ms % 1000 * 1000;
+		if (select(fdsn, &r, &w, NULL, &tv) == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		remote_service(&r, &w);
+	}
+
+	if (!quiet) {
+		if (remote.head < remote.len)
+			warnx("%s: gave up with %lu bytes unsent", remote.addr,
+				(unsigned long)(remote.len - remote.frame));
+		if (remote.dropped)
+			warnx("%s: dropped %lu records", remote.addr, remote.dropped);
+	}
+
+	if (remote.fd != -1)
+		close(remote.fd);
+	if (remote.ai)
+		freeaddrinfo(remote.ai);
+	free(remote.buf);
+	free(remote.partial[0].buf);
+	free(remote.partial[1].buf);
+}
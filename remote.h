@@ -0,0 +1,49 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef REMOTE_H
+#define REMOTE_H
+
+/* -R: ship each line to a collector, as well as everything else. Each
+ * record is framed as
+ *
+ *	u32	length of the rest of the record
+ *	u8	stream: 1 or 2
+ *	u64	wall-clock time it was read, in ns since the epoch
+ *	...	the line, without its newline
+ *
+ * integers big-endian. Records are batched into large writes, sent when
+ * there's enough of them or the oldest has waited long enough. If the
+ * collector is slow or gone, they queue up to a limit and are then
+ * dropped, and the connection is retried with backoff; local output
+ * carries on regardless */
+
+#include <stddef.h>
+
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#else
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include "compat/bool.h"
+#include "compat/__attribute__.h"
+
+/* ADDR is a path to a Unix socket if it has a slash in it, else
+ * HOST:PORT for TCP */
+extern void remote_open(const char *addr) __attribute__((nonnull));
+extern void remote_feed(int fd, const char *buf, size_t n)
+	__attribute__((nonnull, __access__(read_only, 2, 3)));
+
+/* For parent_listen. remote_prepare adds what we're waiting on to the
+ * sets, and returns how many ms until remote_service needs calling
+ * regardless, or -1 for no hurry. remote_service must be called after
+ * every select(2), whatever it returned */
+extern long remote_prepare(fd_set *r, fd_set *w, int *fdsn) __attribute__((nonnull));
+extern void remote_service(const fd_set *r, const fd_set *w) __attribute__((nonnull));
+
+/* Send what's left, giving up after timeout_ms */
+extern void remote_finish(long timeout_ms, bool quiet);
+
+#endif /* REMOTE_H */
@@ -0,0 +1,685 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#include "config.h"
+
+#include <errno.h>
+#include <limits.h>	/* PIPE_BUF */
+#include <signal.h>	/* sigaction(2), SIGINT, SIGTERM */
+#include <stdarg.h>
+#include <stdio.h>	/* sprintf(3), vsnprintf(3) */
+#include <stdlib.h>	/* calloc(3), free(3), atexit(3) */
+#include <string.h>	/* memcmp(3), memcpy(3), strlen(3) */
+
+#include <err.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>	/* lstat(2), fstat(2), umask(2) */
+#include <sys/types.h>
+#include <sys/uio.h>	/* struct iovec */
+#include <sys/un.h>
+#include <sys/wait.h>	/* WIFEXITED(3) and co */
+#include <unistd.h>
+
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include "libssss.h"
+#include "process_cmdline.h"
+#include "serve.h"
+#include "sigevent.h"
+#include "timestamp.h"
+#include "winsize.h"
+
+#include "compat/bool.h"
+#include "compat/inline-restrict.h"
+#include "compat/__attribute__.h"
+
+/* As ssss.c's: how long to wait for the rest of a command's output once
+ * it's exited, without -d, and how much of one stream to take at a time */
+#define DRAIN_MS	1000
+#define QUANTUM		(8 * BUFSIZ)
+
+/* Past this much queued for a job, its pipes aren't read till some of it's
+ * gone out: the command waits on its terminal, as it would without us,
+ * and nobody else does */
+#define BACKLOG		(1024 * 1024)
+
+#ifndef PIPE_BUF
+# define PIPE_BUF	512	/* _POSIX_PIPE_BUF */
+#endif
+
+/* A run in the queue: a byte of which stream (ofd), a size_t of how long,
+ * then that much */
+#define RUN_HEAD	(1 + sizeof(size_t))
+
+/* One ssss-run, and the command it's running */
+struct job {
+	struct job *next;
+	int sock;		/* to ssss-run, or -1 once it's gone */
+	int in[2];		/* the command's pipes, by fd - 1; -1 till
+				 * they're handed over, and once they're done */
+	int out[2];		/* and where they go */
+	int nb[2];		/* our own O_NONBLOCK open file of each of
+				 * out[], to write to, or -1 for none */
+	int sockets;		/* which of out[] are, as watch, for send(2) */
+	int watch;		/* as parent_listen's */
+	struct ssss *fmt;	/* NULL till the fds are handed over */
+	unsigned char flags;	/* serve's, with FLAG_COLOUR as out[] says */
+
+	/* The wait(2) status, as it comes in */
+	unsigned char status[4];
+	int got;
+	bool reaped;
+
+	/* Once the command's exited (or ssss-run's gone without saying),
+	 * when to stop waiting for anything else that has its pipes */
+	uint64_t drain_until;
+	char name[SERVE_NAME + 1];
+
+	/* What's waiting for out[] to take it, in runs, in the order it was
+	 * written: buf[head..len), the latest run at last, to add to */
+	char *buf;
+	size_t cap, len, head, last;
+	bool done;		/* finish()ed; gone once the queue's empty */
+};
+
+static struct job *jobs = NULL;
+static const char *sock_path;
+
+static void
+unlink_sock(void)
+{
+	unlink(sock_path);
+}
+
+static int __attribute__((nonnull))
+listen_on(const char *const path)
+/* As metrics_listen, but 0600 */
+{
+	union {
+		struct sockaddr sa;
+		struct sockaddr_un un;
+	} addr;
+	struct stat st;
+	const size_t len = strlen(path);
+	mode_t mask;
+	int fd;
+
+	if (len >= sizeof addr.un.sun_path)
+		errx(-1, "%s: socket path too long", path);
+
+	memset(&addr, 0, sizeof addr);
+	addr.un.sun_family = AF_UNIX;
+	memcpy(addr.un.sun_path, path, len);
+
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	mask = umask(077);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1 || bind(fd, &addr.sa, sizeof addr.un) != 0
+	    || listen(fd, 64) != 0)
+		err(-1, "--serve %s", path);
+	umask(mask);
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+
+	sock_path = path;
+	atexit(unlink_sock);
+	return fd;
+}
+
+static void __attribute__((nonnull))
+enqueue(struct job *const j, const int ofd, const char *const p, const size_t n)
+/* Onto the latest run, if it's the same stream's, or a new one */
+{
+	const bool more = j->head < j->len && (unsigned char)j->buf[j->last] == ofd;
+	const size_t need = more ? n : n + RUN_HEAD;
+
+	if (j->out[ofd - 1] == -1 || !n)
+		return;
+
+	if (j->cap - j->len < need) {
+		/* Make room by discarding what's written first */
+		if (j->head) {
+			memmove(j->buf, j->buf + j->head, j->len - j->head);
+			j->len -= j->head;
+			j->last -= more ? j->head : 0;
+			j->head = 0;
+		}
+		while (j->cap - j->len < need)
+			j->cap = j->cap ? j->cap * 2 : 64 * 1024;
+		if (!(j->buf = realloc(j->buf, j->cap)))
+			err(-1, NULL);
+	}
+
+	if (more) {
+		size_t run;
+		memcpy(&run, j->buf + j->last + 1, sizeof run);
+		run += n;
+		memcpy(j->buf + j->last + 1, &run, sizeof run);
+	} else {
+		j->last = j->len;
+		j->buf[j->len] = ofd;
+		memcpy(j->buf + j->len + 1, &n, sizeof n);
+		j->len += RUN_HEAD;
+	}
+	memcpy(j->buf + j->len, p, n);
+	j->len += n;
+}
+
+static int
+own_file(const int fd)
+/* A new open file of what fd is, to make O_NONBLOCK without making it so
+ * for everyone else who has their terminal or pipe: by /proc where there's
+ * one, else by ttyname(3) where it's a terminal. Not for a regular file,
+ * which it'd write over from the start, and which doesn't keep anyone
+ * waiting anyway; -1 for that, and for no such luck */
+{
+	char path[sizeof "/proc/self/fd/" + 3 * sizeof(int)];
+	const char *name;
+	struct stat st;
+	int nb;
+
+	if (fstat(fd, &st) || !(S_ISCHR(st.st_mode) || S_ISFIFO(st.st_mode)))
+		return -1;
+	sprintf(path, "/proc/self/fd/%d", fd);
+	if ((nb = open(path, O_WRONLY | O_NOCTTY | O_NONBLOCK)) == -1
+	    && isatty(fd) && (name = ttyname(fd)))
+		nb = open(name, O_WRONLY | O_NOCTTY | O_NONBLOCK);
+	return nb;
+}
+
+static void __attribute__((nonnull))
+give_up_on(struct job *const j, const int ofd)
+/* Their terminal's gone, say; the rest of theirs is for nobody, and
+ * nobody else's is held up for it */
+{
+	close(j->out[ofd - 1]);
+	j->out[ofd - 1] = -1;
+	if (j->nb[ofd - 1] != -1)
+		close(j->nb[ofd - 1]);
+	j->nb[ofd - 1] = -1;
+}
+
+static int __attribute__((nonnull))
+next_out(struct job *const j)
+/* Where the first run in the queue goes, past any for an fd that's been
+ * given up on; -1 if there's nothing queued */
+{
+	while (j->head < j->len) {
+		const int ofd = (unsigned char)j->buf[j->head];
+		size_t run;
+
+		if (j->out[ofd - 1] != -1)
+			return j->out[ofd - 1];
+		memcpy(&run, j->buf + j->head + 1, sizeof run);
+		j->head += RUN_HEAD + run;
+	}
+	j->head = j->len = 0;
+	return -1;
+}
+
+static void __attribute__((nonnull))
+drain(struct job *const j)
+/* As much of the first run as its fd, which select(2) says will take some,
+ * will take. These are someone else's fds, and their terminal's, likely as
+ * not, so no O_NONBLOCK for them: that's on the open file, and would be
+ * theirs too. Ours, from own_file, can have it; a socket, MSG_DONTWAIT;
+ * and anything else no more than PIPE_BUF, which a writable pipe takes
+ * without blocking, and a regular file takes anyway */
+{
+	const int ofd = (unsigned char)j->buf[j->head];
+	const char *const p = j->buf + j->head + RUN_HEAD;
+	size_t run;
+	ssize_t n;
+
+	memcpy(&run, j->buf + j->head + 1, sizeof run);
+	if (j->nb[ofd - 1] != -1)
+		n = write(j->nb[ofd - 1], p, run);
+#ifdef MSG_DONTWAIT
+	else if (j->sockets & ofd)
+		n = send(j->out[ofd - 1], p, run, MSG_DONTWAIT);
+#endif
+	else
+		n = write(j->out[ofd - 1], p, run < PIPE_BUF ? run : PIPE_BUF);
+	if (n == -1) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			give_up_on(j, ofd);
+		return;
+	}
+
+	/* The header moves up over what's been written */
+	if ((size_t)n == run) {
+		j->head += RUN_HEAD + run;
+		return;
+	}
+	if (j->last == j->head)
+		j->last += n;
+	j->head += n;
+	run -= n;
+	j->buf[j->head] = ofd;
+	memcpy(j->buf + j->head + 1, &run, sizeof run);
+}
+
+static void __attribute__((nonnull(3)))
+write_job(void *const ctx, const int ofd,
+		const struct iovec *const iov, const int iovcnt)
+/* ssss_write_fn: into the queue, for drain to write out to wherever
+ * ssss-run said as and when it'll take it */
+{
+	struct job *const j = ctx;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		enqueue(j, ofd, iov[i].iov_base, iov[i].iov_len);
+}
+
+static void __attribute__((nonnull(1, 3), format(printf, 3, 4)))
+say(struct job *const j, const char *const timebuf,
+		const char *const fmt, ...)
+/* warnx(3), but on the command's stderr rather than ours */
+{
+	char msg[TIMESTAMP_SIZE + SERVE_NAME + 128];
+	va_list ap;
+	int n = sprintf(msg, "%sssss: ", timebuf ? timebuf : "");
+
+	va_start(ap, fmt);
+	n += vsnprintf(msg + n, sizeof msg - n - 1, fmt, ap);
+	va_end(ap);
+	if (n > (int)sizeof msg - 1)
+		n = sizeof msg - 1;
+	msg[n++] = '\n';
+	enqueue(j, STDERR_FILENO, msg, n);
+}
+
+static void __attribute__((nonnull))
+report(struct job *const j, const unsigned char flags)
+/* parent_wait_for_child's say on how the command did */
+{
+	char timebuf[TIMESTAMP_SIZE] = "";
+	const int st = j->status[0] << 24 | j->status[1] << 16
+		| j->status[2] << 8 | j->status[3];
+
+	if (flags & FLAG_QUIET
+	    || (WIFEXITED(st) && WEXITSTATUS(st) == EXIT_SUCCESS
+		&& ~flags & FLAG_VERBOSE))
+		return;
+	if (flags & FLAG_TIMESTAMPS)
+		sprint_time(timebuf);
+
+	if (WIFEXITED(st))
+		say(j, timebuf, "%s exited with status %d", j->name, WEXITSTATUS(st));
+	else if (WIFSIGNALED(st))
+#ifdef HAVE_STRSIGNAL
+		say(j, timebuf, "%s killed by signal %d: %s", j->name,
+			WTERMSIG(st), strsignal(WTERMSIG(st)));
+#else
+		say(j, timebuf, "%s killed by signal %d", j->name, WTERMSIG(st));
+#endif
+	else
+		say(j, timebuf, "%s wait(2) status unexpected: %d", j->name, st);
+}
+
+static bool __attribute__((nonnull))
+take_fds(struct job *const j, const unsigned char flags)
+/* ssss-run's first message. Returns whether it was any good */
+{
+	char msg[sizeof SERVE_MAGIC - 1 + SERVE_NAME];
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(SERVE_NFDS * sizeof(int))];
+	} control;
+	int fds[SERVE_NFDS], nfds = 0, i;
+	struct iovec iov;
+	struct msghdr mh;
+	struct cmsghdr *c;
+	ssize_t n;
+
+	iov.iov_base = msg;
+	iov.iov_len = sizeof msg;
+	memset(&mh, 0, sizeof mh);
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = control.buf;
+	mh.msg_controllen = sizeof control.buf;
+
+	n = recvmsg(j->sock, &mh, 0);
+	for (c = n > 0 ? CMSG_FIRSTHDR(&mh) : NULL; c; c = CMSG_NXTHDR(&mh, c))
+		if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+			const int k = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			for (i = 0; i < k && nfds < SERVE_NFDS; i++)
+				memcpy(&fds[nfds++], CMSG_DATA(c) + i * sizeof(int),
+					sizeof(int));
+		}
+
+	if (n < (ssize_t)sizeof SERVE_MAGIC - 1 || nfds != SERVE_NFDS
+	    || mh.msg_flags & MSG_CTRUNC
+	    || memcmp(msg, SERVE_MAGIC, sizeof SERVE_MAGIC - 1)
+	    || fds[0] >= FD_SETSIZE || fds[1] >= FD_SETSIZE
+	    || fds[2] >= FD_SETSIZE || fds[3] >= FD_SETSIZE)
+	{
+		for (i = 0; i < nfds; i++)
+			close(fds[i]);
+		return false;
+	}
+
+	n -= sizeof SERVE_MAGIC - 1;
+	memcpy(j->name, msg + sizeof SERVE_MAGIC - 1, n);
+	j->name[n] = '\0';
+	for (i = 0; i < 2; i++) {
+		struct stat st;
+		j->in[i] = fds[i];
+		j->out[i] = fds[2 + i];
+		fcntl(j->in[i], F_SETFL, O_NONBLOCK);
+		j->nb[i] = own_file(j->out[i]);
+		if (fstat(j->out[i], &st) == 0 && S_ISSOCK(st.st_mode))
+			j->sockets |= i + 1;
+	}
+	j->watch = STDOUT_FILENO | STDERR_FILENO;
+
+	/* do_colour's and -S's looks at the terminal, but it's this one's
+	 * terminal, not ours */
+	j->flags = flags;
+	if (opts.serve_colour && isatty(j->out[0])
+	    && (flags & FLAG_ALLINONE || isatty(j->out[1])))
+		j->flags |= FLAG_COLOUR;
+
+	j->fmt = ssss_new(j->flags, write_job, j);
+	if (opts.group_ms)
+		ssss_set_grouping(j->fmt, opts.group_ms, opts.group_prefixes);
+	if (flags & FLAG_COLUMNS)
+		ssss_set_width(j->fmt, terminal_width_of(j->out[0]));
+	return true;
+}
+
+static void __attribute__((nonnull))
+hang_up(struct job *const j, const int fd)
+{
+	ssss_eof(j->fmt, fd);
+	close(j->in[fd - 1]);
+	j->in[fd - 1] = -1;
+	j->watch &= ~fd;
+}
+
+static void __attribute__((nonnull))
+cat(struct job *const j, const int fd)
+/* cat_in_technicolour, minus the trimmings: up to a quantum of fd, which
+ * select(2) says there's something on */
+{
+	char buf[BUFSIZ] __attribute__((nonstring));
+	long left = QUANTUM;
+	ssize_t n;
+
+	do {
+		if ((n = read(j->in[fd - 1], buf, sizeof buf)) > 0) {
+			ssss_feed(j->fmt, fd, buf, n);
+			left -= n;
+		} else if (n == -1 && errno == EINTR) {
+			continue;
+		} else if (n == 0 || errno != EAGAIN) {
+			hang_up(j, fd);
+			return;
+		}
+	} while (n == BUFSIZ && left > 0);
+}
+
+static void __attribute__((nonnull))
+take_status(struct job *const j)
+/* What ssss-run has to say after the fds, which is the wait(2) status,
+ * or nothing at all, if it's gone */
+{
+	const ssize_t n = read(j->sock, j->status + j->got, sizeof j->status - j->got);
+
+	if (n > 0 && (j->got += n) < (int)sizeof j->status)
+		return;
+	if (n == -1 && errno == EAGAIN)
+		return;
+	if (n > 0)
+		j->reaped = true;
+	else {
+		close(j->sock);
+		j->sock = -1;
+	}
+	j->drain_until = monotonic_ns() + (uint64_t)(opts.drain_ms
+		? opts.drain_ms : DRAIN_MS) * NS_PER_MS;
+}
+
+static void __attribute__((nonnull))
+finish(struct job *const j, const unsigned char flags)
+/* Everything's in that's coming: the last of it, and how it went, into
+ * the queue, for let_go once it's out */
+{
+	if (j->fmt) {
+		if (j->watch & STDERR_FILENO)
+			hang_up(j, STDERR_FILENO);
+		if (j->watch & STDOUT_FILENO)
+			hang_up(j, STDOUT_FILENO);
+		ssss_flush(j->fmt);
+		ssss_free(j->fmt);
+		j->fmt = NULL;
+		/* clean_up_colour's, for the likes of ^C */
+		if (j->flags & FLAG_COLOUR)
+			enqueue(j, STDOUT_FILENO, "\033[m", 3);
+		if (j->reaped)
+			report(j, flags);
+	}
+	j->done = true;
+}
+
+static void __attribute__((nonnull))
+let_go(struct job *const j)
+/* Let ssss-run go, by closing its socket, and see the last of it */
+{
+	int i;
+
+	for (i = 0; i < 2; i++)
+		if (j->out[i] != -1)
+			give_up_on(j, i + 1);
+	if (j->sock != -1)
+		close(j->sock);
+	free(j->buf);
+	free(j);
+}
+
+extern int __attribute__((nonnull))
+serve(const char *const path, const unsigned char flags)
+{
+	const int lfd = listen_on(path);
+	struct sigaction sa;
+	bool stopping = false;
+	int sigfd;
+
+	/* Anyone's terminal can go away without it being the end of us.
+	 * SIGINT and SIGTERM, on the other hand, are, and come in as
+	 * parent_listen's do, to select(2) on with everything else: a flag
+	 * set by a handler could come in between looking at it and
+	 * select(2), and not be looked at again till something else did */
+	sa.sa_handler = SIG_IGN;
+	sa.sa_flags = 0;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGPIPE, &sa, NULL);
+	sigfd = sigevent_open(true);
+	sigevent_add(SIGTERM);
+	if (sigfd >= FD_SETSIZE)
+		errx(-1, "too many files open already for select(2)");
+
+	if (flags & FLAG_VERBOSE)
+		warnx("serving on %s", path);
+
+	while (!stopping) {
+		fd_set fds, w;
+		struct timeval tv;
+		struct job *j, **jp;
+		long ms = -1;
+		int fdsn = (lfd > sigfd ? lfd : sigfd) + 1;
+
+		FD_ZERO(&fds);
+		FD_ZERO(&w);
+		FD_SET(lfd, &fds);
+		FD_SET(sigfd, &fds);
+		for (j = jobs; j; j = j->next) {
+			const int out = next_out(j);
+			int i;
+			if (j->sock != -1 && !j->reaped && !j->done) {
+				FD_SET(j->sock, &fds);
+				if (j->sock >= fdsn)
+					fdsn = j->sock + 1;
+			}
+			for (i = 0; i < 2; i++)
+				if (j->in[i] != -1 && j->len - j->head < BACKLOG) {
+					FD_SET(j->in[i], &fds);
+					if (j->in[i] >= fdsn)
+						fdsn = j->in[i] + 1;
+				}
+			if (out != -1) {
+				FD_SET(out, &w);
+				if (out >= fdsn)
+					fdsn = out + 1;
+			}
+			if (j->drain_until && j->watch)
+				ms = sooner(ms, ms_until(j->drain_until));
+			if (opts.group_ms && j->fmt)
+				ms = sooner(ms, ssss_hold_ms(j->fmt));
+		}
+
+		if (ms != -1)
+			tv.tv_sec = ms / 1000, tv.tv_usec = ms % 1000 * 1000;
+		if (select(fdsn, &fds, &w, NULL, ms != -1 ? &tv : NULL) == -1) {
+			if (errno == EINTR)
+				continue;
+			err(-1, "select(2)");
+		}
+
+		if (FD_ISSET(sigfd, &fds)) {
+			int sig;
+			while ((sig = sigevent_next()))
+				if (sig == SIGINT || sig == SIGTERM)
+					stopping = true;
+		}
+
+		if (FD_ISSET(lfd, &fds)) {
+			const int fd = accept(lfd, NULL, NULL);
+			if (fd >= FD_SETSIZE) {
+				warnx("too many at once; turning one away");
+				close(fd);
+			} else if (fd != -1) {
+				if (!(j = calloc(1, sizeof *j)))
+					err(-1, NULL);
+				j->sock = fd;
+				j->in[0] = j->in[1] = j->out[0] = j->out[1] = -1;
+				j->nb[0] = j->nb[1] = -1;
+				fcntl(fd, F_SETFL, O_NONBLOCK);
+				j->next = jobs;
+				jobs = j;
+			}
+		}
+
+		for (jp = &jobs; (j = *jp);) {
+			/* The queue's as it was for select(2), so the first run's
+			 * still the one it was asked about */
+			{
+				const int out = next_out(j);
+				if (out != -1 && FD_ISSET(out, &w))
+					drain(j);
+			}
+
+			if (j->sock != -1 && !j->done && FD_ISSET(j->sock, &fds)) {
+				if (!j->fmt) {
+					if (!take_fds(j, flags)) {
+						if (~flags & FLAG_QUIET)
+							warnx("that's not ssss-run; hanging up");
+						close(j->sock);
+						j->sock = -1;
+					}
+				} else
+					take_status(j);
+			}
+
+			/* stderr first, as ever */
+			if (j->in[1] != -1 && FD_ISSET(j->in[1], &fds))
+				cat(j, STDERR_FILENO);
+			if (j->in[0] != -1 && FD_ISSET(j->in[0], &fds))
+				cat(j, STDOUT_FILENO);
+
+			if (j->fmt && j->drain_until && j->watch
+			    && ms_until(j->drain_until) == 0) {
+				if (j->watch & STDERR_FILENO)
+					cat(j, STDERR_FILENO);
+				if (j->watch & STDOUT_FILENO)
+					cat(j, STDOUT_FILENO);
+				if (j->watch && ~flags & FLAG_QUIET)
+					say(j, NULL, "%s exited, but something still has its output open; not waiting for it",
+						j->name);
+				if (j->watch & STDERR_FILENO)
+					hang_up(j, STDERR_FILENO);
+				if (j->watch & STDOUT_FILENO)
+					hang_up(j, STDOUT_FILENO);
+			}
+			if (j->fmt)
+				ssss_flush(j->fmt);
+
+			/* Done with, once there's no more output, and
+			 * either we know how it exited or there's nobody
+			 * to tell; or if it was never ssss-run at all. Gone
+			 * once all that's been written */
+			if (!j->done && (j->fmt ? !j->watch && (j->reaped || j->sock == -1)
+			    : j->sock == -1))
+				finish(j, flags);
+			if (j->done && next_out(j) == -1) {
+				*jp = j->next;
+				let_go(j);
+			} else
+				jp = &j->next;
+		}
+	}
+
+	/* Whoever's left gets what there is so far, and DRAIN_MS to take
+	 * it, as fanout_close gives the sinks */
+	{
+		const uint64_t give_up_at = monotonic_ns() + (uint64_t)DRAIN_MS * NS_PER_MS;
+		struct job *j;
+		long ms;
+
+		for (j = jobs; j; j = j->next)
+			if (!j->done)
+				finish(j, flags);
+		while ((ms = ms_until(give_up_at)) > 0) {
+			fd_set w;
+			struct timeval tv;
+			int fdsn = 0;
+
+			FD_ZERO(&w);
+			for (j = jobs; j; j = j->next) {
+				const int out = next_out(j);
+				if (out != -1) {
+					FD_SET(out, &w);
+					if (out >= fdsn)
+						fdsn = out + 1;
+				}
+			}
+			if (!fdsn)
+				break;
+			tv.tv_sec = ms / 1000, tv.tv_usec = ms % 1000 * 1000;
+			if (select(fdsn, NULL, &w, NULL, &tv) == -1) {
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			for (j = jobs; j; j = j->next) {
+				const int out = next_out(j);
+				if (out != -1 && FD_ISSET(out, &w))
+					drain(j);
+			}
+		}
+	}
+	while (jobs) {
+		struct job *const j = jobs;
+		jobs = j->next;
+		let_go(j);
+	}
+	close(lfd);
+	return 0;
+}
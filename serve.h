@@ -0,0 +1,44 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef SERVE_H
+#define SERVE_H
+
+/* ssss --serve PATH: one ssss that stays up, for ssss-run to hand each
+ * command's output to, so that a CI job of a thousand little steps pays
+ * for starting ssss, setlocale(3) and the look through environ for NO_COLOR
+ * the once, not a thousand times. The formatting is whatever --serve's
+ * OPT(s) said, for everyone, but for what depends on the terminal: colour,
+ * without -c or -C, and -S's width are as each ssss-run's stdout says.
+ *
+ * ssss-run makes the command's pipes, runs it, and connects to PATH, an
+ * AF_UNIX stream socket; then it's one message,
+ *
+ *	4	"SSR1"
+ *	...	the command's name, for saying how it exited, up to
+ *		SERVE_NAME bytes
+ *
+ * with four fds along with it, SCM_RIGHTS: the read ends of the command's
+ * stdout and stderr pipes, and where they're to go, which is ssss-run's
+ * own stdout and stderr. The server reads the one and writes the other,
+ * along with everyone else's, all in the one select(2) loop, each one's
+ * output queued till its terminal will take it, so that one that's been
+ * ^S'd holds up nobody but its own command. Once the command's exited,
+ * ssss-run sends its wait(2) status, a u32, big-endian, and waits; the
+ * server closes the connection when it's seen the end of the command's
+ * output (or given up on it, as for -d), said how it exited, if it's to
+ * say, and written it all out. Then ssss-run exits as the command did.
+ *
+ * The fds don't go anywhere near the filesystem, so anyone who can connect
+ * to PATH can have the server write to anything they can; it's as good as
+ * their own, and PATH is made 0600 for the rest */
+
+#include "compat/__attribute__.h"
+
+#define SERVE_MAGIC	"SSR1"
+#define SERVE_NAME	255
+#define SERVE_NFDS	4
+
+/* Serve on PATH until SIGINT or SIGTERM, and return what ssss should */
+extern int serve(const char *path, unsigned char flags) __attribute__((nonnull));
+
+#endif /* SERVE_H */
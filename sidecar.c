@@ -0,0 +1,82 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>	/* memcpy(3), memset(3) */
+
+#include <err.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>	/* lseek(2) */
+
+#include "libssss.h"	/* FLAG_ALLINONE */
+#include "sidecar.h"
+#include "timestamp.h"
+
+#include "compat/bool.h"
+#include "compat/unlocked-stdio.h"
+#include "compat/__attribute__.h"
+
+static struct {
+	FILE *f;
+	const char *path;
+	uint64_t offset[2];	/* of the next byte of output, by ofd - 1 */
+	bool allinone;
+} sc;
+
+extern void __attribute__((nonnull))
+sidecar_open(const char *const path, const unsigned char flags)
+{
+	unsigned char header[SIDECAR_HEADER];
+	int i;
+
+	if (!(sc.f = fopen(path, "wb")))
+		err(-1, "%s", path);
+	fcntl(fileno(sc.f), F_SETFD, FD_CLOEXEC); /* not for the child */
+	sc.path = path;
+	sc.allinone = flags & FLAG_ALLINONE;
+
+	/* If the output's a file we've been appended to, the offsets had
+	 * better be where in that file. Else (a pipe, say) from 0 */
+	for (i = 0; i < 2; i++) {
+		const off_t o = lseek(i + 1, 0, SEEK_CUR);
+		sc.offset[i] = o == -1 ? 0 : (uint64_t)o;
+	}
+
+	memset(header, 0, sizeof header);
+	memcpy(header, SIDECAR_MAGIC, 8);
+	sidecar_put(header + 8, realtime_ns(), 8);
+	sidecar_put(header + 16, monotonic_ns(), 8);
+	header[24] = sc.allinone ? SIDECAR_ALLINONE : 0;
+	/* Out now, not in a buffer the child has a copy of too, for it to
+	 * write out again if its exec(3) fails */
+	if (fwrite(header, 1, sizeof header, sc.f) != sizeof header || fflush(sc.f))
+		err(-1, "%s", path);
+}
+
+extern void
+sidecar_note(const int fd, const size_t n)
+/* Called with each read(2)'s worth, once it's been written out. The
+ * entries pile up in stdio's buffer, to be written out a page or so at a
+ * time */
+{
+	unsigned char e[SIDECAR_ENTRY];
+	uint64_t *const offset = &sc.offset[sc.allinone ? 0 : fd - 1];
+
+	sidecar_put(e, *offset, 8);
+	sidecar_put(e + 8, n, 4);
+	e[12] = fd;
+	e[13] = e[14] = e[15] = 0;
+	sidecar_put(e + 16, monotonic_ns(), 8);
+	fwrite(e, 1, sizeof e, sc.f);
+
+	*offset += n;
+}
+
+extern void
+sidecar_close(void)
+{
+	if (fclose(sc.f))
+		warn("%s", sc.path);
+}
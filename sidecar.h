@@ -0,0 +1,60 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef SIDECAR_H
+#define SIDECAR_H
+
+/* -X: the child's output goes through untouched, and what came from where
+ * and when goes in a file alongside, for ssss-index to make sense of
+ * later. The file is a header,
+ *
+ *	8	"SSSSIDX1"
+ *	u64	wall-clock time we started, in ns since the epoch
+ *	u64	monotonic time we started, in ns
+ *	u8	SIDECAR_ALLINONE if both streams went to stdout (-1)
+ *	7	zeroes
+ *
+ * then an entry for every read(2) from the child,
+ *
+ *	u64	offset in the output it went to (its own stream's, unless
+ *		SIDECAR_ALLINONE), counting from where that was when we started
+ *	u32	length
+ *	u8	stream: 1 or 2
+ *	3	zeroes
+ *	u64	monotonic time it was read, in ns
+ *
+ * integers big-endian, like -R's. Entries are in order of time */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "compat/inline-restrict.h"
+#include "compat/__attribute__.h"
+
+#define SIDECAR_MAGIC	"SSSSIDX1"
+#define SIDECAR_HEADER	32
+#define SIDECAR_ENTRY	24
+#define SIDECAR_ALLINONE 1
+
+static __inline__ void __attribute__((nonnull))
+sidecar_put(unsigned char *const p, uint64_t x, int n)
+{
+	while (n--)
+		p[n] = x & 0xff, x >>= 8;
+}
+
+static __inline__ uint64_t __attribute__((nonnull))
+sidecar_get(const unsigned char *const p, const int n)
+{
+	uint64_t x = 0;
+	int i;
+	for (i = 0; i < n; i++)
+		x = x << 8 | p[i];
+	return x;
+}
+
+/* For ssss itself */
+extern void sidecar_open(const char *path, unsigned char flags) __attribute__((nonnull));
+extern void sidecar_note(int fd, size_t n);
+extern void sidecar_close(void);
+
+#endif /* SIDECAR_H */
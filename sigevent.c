@@ -0,0 +1,120 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#include "config.h"
+
+#include <errno.h>
+#include <signal.h>
+
+#include <err.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_SIGNALFD_H
+#include <sys/signalfd.h>
+#endif
+
+#include "sigevent.h"
+
+#include "compat/bool.h"
+
+static sigset_t set;
+
+#ifdef HAVE_SYS_SIGNALFD_H
+static sigset_t old;	/* for the child to go back to */
+static int sfd;
+#else
+static int self[2];	/* [1] for the handler to write to, [0] to read */
+
+static void
+handler(const int sig)
+{
+	const int e = errno;
+	const unsigned char c = sig;
+	/* If the pipe's full, there's enough waiting to wake us up anyway */
+	write(self[1], &c, 1);
+	errno = e;
+}
+#endif
+
+extern int
+sigevent_open(const bool intr)
+{
+	sigemptyset(&set);
+	sigaddset(&set, SIGCHLD);
+	sigaddset(&set, SIGWINCH);
+	if (intr)
+		sigaddset(&set, SIGINT);
+
+#ifdef HAVE_SYS_SIGNALFD_H
+	/* Blocked first, so none of them can slip through between here and
+	 * the fd: SIGCHLD and SIGWINCH would be dropped on the floor */
+	if (sigprocmask(SIG_BLOCK, &set, &old))
+		err(-1, "sigprocmask(2)");
+	if ((sfd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC)) == -1)
+		err(-1, "signalfd(2)");
+	return sfd;
+#else
+	{
+		struct sigaction sa;
+		int i;
+
+		if (pipe(self))
+			err(-1, "pipe(2)");
+		for (i = 0; i < 2; i++) {
+			fcntl(self[i], F_SETFL, O_NONBLOCK);
+			fcntl(self[i], F_SETFD, FD_CLOEXEC);
+		}
+
+		sa.sa_handler = handler;
+		sa.sa_flags = SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+		if (sigaction(SIGCHLD, &sa, NULL) || sigaction(SIGWINCH, &sa, NULL)
+		    || (intr && sigaction(SIGINT, &sa, NULL)))
+			err(-1, "sigaction(2)");
+	}
+	return self[0];
+#endif
+}
+
+extern void
+sigevent_add(const int sig)
+{
+	sigaddset(&set, sig);
+#ifdef HAVE_SYS_SIGNALFD_H
+	if (sigprocmask(SIG_BLOCK, &set, NULL))
+		err(-1, "sigprocmask(2)");
+	if (signalfd(sfd, &set, 0) == -1)
+		err(-1, "signalfd(2)");
+#else
+	{
+		struct sigaction sa;
+
+		sa.sa_handler = handler;
+		sa.sa_flags = SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+		if (sigaction(sig, &sa, NULL))
+			err(-1, "sigaction(2)");
+	}
+#endif
+}
+
+extern void
+sigevent_child(void)
+/* The handlers go of themselves with exec(3), and the fds with
+ * FD_CLOEXEC; the mask doesn't */
+{
+#ifdef HAVE_SYS_SIGNALFD_H
+	sigprocmask(SIG_SETMASK, &old, NULL);
+#endif
+}
+
+extern int
+sigevent_next(void)
+{
+#ifdef HAVE_SYS_SIGNALFD_H
+	struct signalfd_siginfo si;
+	return read(sfd, &si, sizeof si) == sizeof si ? (int)si.ssi_signo : 0;
+#else
+	unsigned char c;
+	return read(self[0], &c, 1) == 1 ? c : 0;
+#endif
+}
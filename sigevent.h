@@ -0,0 +1,27 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef SIGEVENT_H
+#define SIGEVENT_H
+
+/* Signals as something for parent_listen to select(2) on, along with
+ * everything else, rather than handlers going off in the middle of it:
+ * SIGCHLD, so we know when the child's gone without waiting for its
+ * pipes to close (which they never might, if it's left something running
+ * that has them), SIGWINCH, and SIGINT if asked, and whatever else sigevent_add says.
+ * A signalfd(2) where there is such a thing, else handlers writing down a
+ * pipe to ourselves */
+
+#include "compat/bool.h"
+
+/* Call before fork(2), and sigevent_child in the child. Returns the fd to
+ * select(2) on for reading */
+extern int sigevent_open(bool intr);
+extern void sigevent_child(void);
+
+/* One more for the fd, after sigevent_open: --serve's SIGTERM */
+extern void sigevent_add(int sig);
+
+/* The next signal that's come in, or 0 for no more for now */
+extern int sigevent_next(void);
+
+#endif /* SIGEVENT_H */
@@ -0,0 +1,227 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * The other half of ssss -X: makes sense of the index it left, and of the
+ * raw output it was of, without ssss having had to format a thing while
+ * PROG was running.
+ *
+ *	$ ssss -1 -X build.idx make > build.log
+ *	$ ssss-index build.idx			# what's in the index
+ *	$ ssss-index -s 2 build.idx build.log	# just what make said on stderr
+ *	$ ssss-index -a -f 60 -u 90 build.idx build.log
+ *			# a minute in, for half a minute, as ssss -t -p would
+ *			# have had it
+ *
+ * -f and -u are seconds since ssss started, fractional if you like, and are
+ * found by binary search, so a slice of a big log costs about what the
+ * slice does. Without -1, each stream went to its own file, so pick one with
+ * -s to go with it. `make ssss-index' builds it */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>	/* strtod(3), strtoul(3) */
+#include <string.h>	/* memcmp(3), memchr(3) */
+#include <time.h>	/* localtime(3) */
+
+#include <err.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>	/* getopt(3), pread(2) */
+
+#include "sidecar.h"
+
+#include "compat/__attribute__.h"
+
+struct entry {
+	uint64_t offset, ns;
+	unsigned long len;
+	int fd;
+};
+
+static struct {
+	const unsigned char *entries;
+	size_t n;
+	uint64_t real0, mono0;
+	int allinone;
+} idx;
+
+static void
+entry(const size_t i, struct entry *const e)
+{
+	const unsigned char *const p = idx.entries + i * SIDECAR_ENTRY;
+	e->offset = sidecar_get(p, 8);
+	e->len = sidecar_get(p + 8, 4);
+	e->fd = p[12];
+	e->ns = sidecar_get(p + 16, 8);
+}
+
+static size_t
+first_at(const uint64_t ns)
+/* The first entry read at or after ns, or idx.n if there's none */
+{
+	size_t lo = 0, hi = idx.n;
+
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (sidecar_get(idx.entries + mid * SIDECAR_ENTRY + 16, 8) < ns)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static void __attribute__((nonnull))
+load(const char *const path)
+{
+	const unsigned char *map;
+	struct stat st;
+	const int fd = open(path, O_RDONLY);
+
+	if (fd == -1 || fstat(fd, &st))
+		err(-1, "%s", path);
+	if (st.st_size < SIDECAR_HEADER)
+		errx(-1, "%s: too short to be an index", path);
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		err(-1, "%s", path);
+	close(fd);
+	if (memcmp(map, SIDECAR_MAGIC, 8))
+		errx(-1, "%s: not an ssss -X index", path);
+
+	idx.real0 = sidecar_get(map + 8, 8);
+	idx.mono0 = sidecar_get(map + 16, 8);
+	idx.allinone = map[24] & SIDECAR_ALLINONE;
+	idx.entries = map + SIDECAR_HEADER;
+	/* If ssss was killed mid-entry, the last one's no good */
+	idx.n = (st.st_size - SIDECAR_HEADER) / SIDECAR_ENTRY;
+}
+
+static size_t __attribute__((nonnull))
+annotate(char *const buf, const struct entry *const e)
+/* `[21:34:56.135429]&1 ', as ssss -t -p would have put it */
+{
+	const uint64_t ns = idx.real0 + (e->ns - idx.mono0);
+	const time_t secs = ns / 1000000000;
+	const struct tm *const tm = localtime(&secs);
+
+	return sprintf(buf, "[%02d:%02d:%02d.%06lu]&%d ", tm->tm_hour,
+		tm->tm_min, tm->tm_sec, (unsigned long)(ns % 1000000000 / 1000),
+		e->fd);
+}
+
+static void __attribute__((nonnull))
+cat(const int raw, const char *const path, const struct entry *const e,
+	const int annotating)
+/* Copy e's bytes of raw to stdout, with a prefix on each line if
+ * annotating. Lines cut short by the other stream get one too, as they did
+ * from ssss */
+{
+	static char buf[1 << 16];
+	static int bol = 1, last_fd;
+	char prefix[64];
+	size_t plen = 0;
+	unsigned long done = 0;
+
+	if (annotating) {
+		plen = annotate(prefix, e);
+		if (e->fd != last_fd)
+			bol = 1;
+		last_fd = e->fd;
+	}
+
+	while (done < e->len) {
+		const size_t want = e->len - done < sizeof buf ? e->len - done : sizeof buf;
+		const ssize_t k = pread(raw, buf, want, e->offset + done);
+		const char *p = buf, *nl;
+
+		if (k == -1)
+			err(-1, "%s", path);
+		if (k == 0)
+			errx(-1, "%s: ends before offset %lu; is it the right file?",
+				path, (unsigned long)(e->offset + done));
+
+		if (!annotating)
+			fwrite(buf, 1, k, stdout);
+		else for (; p < buf + k; p = nl) {
+			if (bol)
+				fwrite(prefix, 1, plen, stdout);
+			nl = memchr(p, '\n', buf + k - p);
+			nl = nl ? nl + 1 : buf + k;
+			bol = nl[-1] == '\n';
+			fwrite(p, 1, nl - p, stdout);
+		}
+		done += k;
+	}
+}
+
+static uint64_t __attribute__((nonnull))
+parse_secs(const char *const progname, const int opt, const char *const arg)
+{
+	char *end;
+	const double secs = strtod(arg, &end);
+	if (end == arg || *end || secs < 0) {
+		fprintf(stderr, "%s: -%c: seconds, please, not `%s'\n",
+			progname, opt, arg);
+		exit(-1);
+	}
+	return secs * 1e9;
+}
+
+int
+main(const int argc, char *const *const argv)
+{
+	uint64_t from = 0, until = 0;
+	int stream = 0, annotating = 0, raw = -1, o;
+	size_t i;
+
+	while ((o = getopt(argc, argv, "af:s:u:")) != -1)
+		switch (o) {
+		case 'a':	annotating = 1; break;
+		case 'f':	from = parse_secs(*argv, 'f', optarg); break;
+		case 'u':	until = parse_secs(*argv, 'u', optarg); break;
+		case 's':
+			stream = strtoul(optarg, NULL, 10);
+			if (stream == 1 || stream == 2)
+				break;
+			/*@fallthrough@*/
+		default:
+			fprintf(stderr, "Usage: %s [-a] [-s 1|2] [-f SECS] [-u SECS] INDEX [RAW]\n",
+				argv[0]);
+			return -1;
+		}
+	if (argc - optind < 1 || argc - optind > 2)
+		errx(-1, "an index, and optionally the output it's of, please");
+
+	load(argv[optind]);
+	if (argv[optind + 1]) {
+		if (!idx.allinone && !stream)
+			errx(-1, "%s: the streams went to different files; "
+				"which is %s? Say with -s", argv[optind],
+				argv[optind + 1]);
+		if ((raw = open(argv[optind + 1], O_RDONLY)) == -1)
+			err(-1, "%s", argv[optind + 1]);
+	} else
+		puts("secs\tstream\toffset\tlength");
+
+	for (i = first_at(idx.mono0 + from); i < idx.n; i++) {
+		struct entry e;
+		entry(i, &e);
+		if (until && e.ns > idx.mono0 + until)
+			break;
+		if (stream && e.fd != stream)
+			continue;
+
+		if (raw == -1)
+			printf("%.6f\t%d\t%lu\t%lu\n", (e.ns - idx.mono0) / 1e9,
+				e.fd, (unsigned long)e.offset, e.len);
+		else
+			cat(raw, argv[optind + 1], &e, annotating);
+	}
+
+	if (fflush(stdout))
+		err(-1, "stdout");
+	return 0;
+}
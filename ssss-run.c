@@ -0,0 +1,144 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * The other half of ssss --serve: runs PROG, and has the ssss on SOCKET do
+ * the rest, so there's nothing to start up here but this. No stdio, no
+ * locale, no looking at the terminal; a connect(2), a sendmsg(2) of its
+ * pipes, a fork(2), and a write(2) of how it went.
+ *
+ *	$ ssss -t --serve /tmp/ssss.sock &
+ *	$ ssss-run /tmp/ssss.sock make -C foo
+ *	$ ssss-run /tmp/ssss.sock make -C bar
+ *
+ * Exits as PROG did, once the server's seen the end of its output. See
+ * serve.h for what goes over the socket. `make ssss-run' builds it */
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>	/* strlen(3), memcpy(3), memset(3), strerror(3) */
+
+#include <err.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "serve.h"
+
+#include "compat/__attribute__.h"
+
+static void __attribute__((nonnull))
+send_fds(const int sock, const char *const prog, const int out, const int errs)
+{
+	char msg[sizeof SERVE_MAGIC - 1 + SERVE_NAME];
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(SERVE_NFDS * sizeof(int))];
+	} control;
+	int fds[SERVE_NFDS];
+	size_t len = strlen(prog);
+	struct iovec iov;
+	struct msghdr mh;
+	struct cmsghdr *c;
+
+	if (len > SERVE_NAME)
+		len = SERVE_NAME;
+	memcpy(msg, SERVE_MAGIC, sizeof SERVE_MAGIC - 1);
+	memcpy(msg + sizeof SERVE_MAGIC - 1, prog, len);
+	iov.iov_base = msg;
+	iov.iov_len = sizeof SERVE_MAGIC - 1 + len;
+
+	/* PROG's, and where they go, which is wherever ours do */
+	fds[0] = out, fds[1] = errs;
+	fds[2] = STDOUT_FILENO, fds[3] = STDERR_FILENO;
+
+	memset(&mh, 0, sizeof mh);
+	memset(&control, 0, sizeof control);
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = control.buf;
+	mh.msg_controllen = sizeof control.buf;
+	c = CMSG_FIRSTHDR(&mh);
+	c->cmsg_level = SOL_SOCKET;
+	c->cmsg_type = SCM_RIGHTS;
+	c->cmsg_len = CMSG_LEN(sizeof fds);
+	memcpy(CMSG_DATA(c), fds, sizeof fds);
+
+	if (sendmsg(sock, &mh, 0) == -1)
+		err(-1, "sendmsg(2)");
+}
+
+int
+main(const int argc, char *const *const argv)
+{
+	union {
+		struct sockaddr sa;
+		struct sockaddr_un un;
+	} addr;
+	int sock, out[2], errs[2], status;
+	unsigned char st[4];
+	pid_t pid;
+	char c;
+
+	if (argc < 3)
+		errx(-1, "usage: %s SOCKET PROG [PROGARG(s)]", argv[0]);
+
+	if (strlen(argv[1]) >= sizeof addr.un.sun_path)
+		errx(-1, "%s: socket path too long", argv[1]);
+	memset(&addr, 0, sizeof addr);
+	addr.un.sun_family = AF_UNIX;
+	memcpy(addr.un.sun_path, argv[1], strlen(argv[1]));
+
+	/* All of it before PROG's started, so that if there's no ssss to
+	 * be had, it never is */
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1
+	    || connect(sock, &addr.sa, sizeof addr.un) == -1)
+		err(-1, "%s", argv[1]);
+	if (pipe(out) || pipe(errs))
+		err(-1, "pipe(2)");
+	send_fds(sock, argv[2], out[0], errs[0]);
+	close(out[0]);
+	close(errs[0]);
+
+	switch ((pid = fork())) {
+	case -1:	err(-1, "fork(2)");
+	case 0:
+		close(sock);
+		dup2(out[1], STDOUT_FILENO);
+		dup2(errs[1], STDERR_FILENO);
+		close(out[1]);
+		close(errs[1]);
+		execvp(argv[2], argv + 2);
+		/* Into the pipe, so the server says it for us; in the one
+		 * write(2), so it's the one line to the server, not
+		 * err(3)'s several */
+		{
+			const char *const e = strerror(errno);
+			struct iovec iov[5];
+			iov[0].iov_base = (char *)"ssss-run: ", iov[0].iov_len = 10;
+			iov[1].iov_base = argv[2], iov[1].iov_len = strlen(argv[2]);
+			iov[2].iov_base = (char *)": ", iov[2].iov_len = 2;
+			iov[3].iov_base = (char *)e, iov[3].iov_len = strlen(e);
+			iov[4].iov_base = (char *)"\n", iov[4].iov_len = 1;
+			writev(STDERR_FILENO, iov, 5);
+			_exit(-1);
+		}
+	}
+	close(out[1]);
+	close(errs[1]);
+
+	while (waitpid(pid, &status, 0) == -1)
+		if (errno != EINTR)
+			err(-1, "waitpid(2)");
+
+	/* How it went, and then wait for the server to be done with it */
+	st[0] = status >> 24, st[1] = status >> 16, st[2] = status >> 8, st[3] = status;
+	if (write(sock, st, sizeof st) != sizeof st)
+		warn("%s", argv[1]);
+	while (read(sock, &c, 1) == -1 && errno == EINTR)
+		;
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : status;
+}
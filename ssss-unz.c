@@ -0,0 +1,142 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * The other half of ssss -L compress: uncompresses what -l left, all of it
+ * or from anywhere in it, hopping from block header to block header to get
+ * there rather than uncompressing everything up to it.
+ *
+ *	$ ssss -l build.log.ssz -L compress,size=1G make
+ *	$ ssss-unz build.log.ssz | less		# all of it
+ *	$ ssss-unz -o 5G -n 1M build.log.ssz	# a meg, five gigs in
+ *	$ ssss-unz -l build.log.ssz		# what blocks there are
+ *
+ * -o and -n are of the log uncompressed, in bytes, or K, M or G of them.
+ * Several files are one after the other, as for cat(1), though -o and -n
+ * start afresh with each. `make ssss-unz' builds it */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>	/* strtoul(3) */
+
+#include <err.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>	/* getopt(3), pread(2) */
+
+#include "lz.h"
+
+#include "compat/__attribute__.h"
+
+static unsigned char in[LZ_BOUND(LZ_BLOCK)], out[LZ_BLOCK];
+
+static uint64_t __attribute__((nonnull))
+parse_bytes(const char *const progname, const int opt, const char *const arg)
+{
+	char *end;
+	uint64_t n = strtoul(arg, &end, 10);
+	switch (*end) {
+	case 'G': case 'g': n <<= 10; /*@fallthrough@*/
+	case 'M': case 'm': n <<= 10; /*@fallthrough@*/
+	case 'K': case 'k': n <<= 10; end++;
+	}
+	if (end == arg || *end) {
+		fprintf(stderr, "%s: -%c: bytes, please, not `%s'\n",
+			progname, opt, arg);
+		exit(-1);
+	}
+	return n;
+}
+
+static void __attribute__((nonnull))
+unz(const char *const path, const uint64_t from, const uint64_t count,
+	const int listing)
+/* count 0 for all of it */
+{
+	const int fd = open(path, O_RDONLY);
+	unsigned char h[LZ_HEADER];
+	off_t at = 0;
+	ssize_t k;
+
+	if (fd == -1)
+		err(-1, "%s", path);
+
+	while ((k = pread(fd, h, sizeof h, at)) == sizeof h) {
+		unsigned long clen, n, skip, len;
+		uint64_t raw;
+		const unsigned char *p = in;
+
+		if (lz_read_header(h, &clen, &n, &raw))
+			errx(-1, "%s: no block at %lu; is it from ssss -L compress?",
+				path, (unsigned long)at);
+		at += LZ_HEADER;
+
+		if (listing) {
+			printf("%lu\t%lu\t%lu\t%lu%s\n", (unsigned long)(at - LZ_HEADER),
+				(unsigned long)raw, n, clen & ~LZ_STORED,
+				clen & LZ_STORED ? "\tstored" : "");
+			at += clen & ~LZ_STORED;
+			continue;
+		}
+
+		/* Not there yet: on to the next header */
+		if (raw + n <= from) {
+			at += clen & ~LZ_STORED;
+			continue;
+		}
+		if (count && raw >= from + count)
+			break;
+
+		if ((k = pread(fd, in, clen & ~LZ_STORED, at)) != (ssize_t)(clen & ~LZ_STORED)) {
+			if (k == -1)
+				err(-1, "%s", path);
+			/* ssss didn't get to finish it; that's the end */
+			break;
+		}
+		at += clen & ~LZ_STORED;
+		if (~clen & LZ_STORED) {
+			if (lz_decompress(in, clen, out, sizeof out) != (long)n)
+				errx(-1, "%s: block at %lu is corrupt", path,
+					(unsigned long)(at - clen - LZ_HEADER));
+			p = out;
+		}
+
+		skip = from > raw ? from - raw : 0;
+		len = n - skip;
+		if (count && raw + skip + len > from + count)
+			len = from + count - raw - skip;
+		fwrite(p + skip, 1, len, stdout);
+	}
+	if (k == -1)
+		err(-1, "%s", path);
+
+	close(fd);
+}
+
+int
+main(const int argc, char *const *const argv)
+{
+	uint64_t from = 0, count = 0;
+	int listing = 0, o;
+
+	while ((o = getopt(argc, argv, "ln:o:")) != -1)
+		switch (o) {
+		case 'l':	listing = 1; break;
+		case 'n':	count = parse_bytes(*argv, 'n', optarg); break;
+		case 'o':	from = parse_bytes(*argv, 'o', optarg); break;
+		default:
+			fprintf(stderr, "Usage: %s [-l] [-o BYTES] [-n BYTES] FILE...\n",
+				argv[0]);
+			return -1;
+		}
+	if (optind == argc)
+		errx(-1, "a log from ssss -L compress, please");
+
+	if (listing)
+		puts("offset\traw\tlength\tcompressed");
+	for (; optind < argc; optind++)
+		unz(argv[optind], from, count, listing);
+
+	if (fflush(stdout))
+		err(-1, "stdout");
+	return 0;
+}
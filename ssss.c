@@ -57,14 +57,16 @@ foo(const size_t n,
 #include <locale.h>	/* setlocale(3) */
 #include <stdio.h>
 #include <stdlib.h>	/* atexit(3) */
-#include <string.h>	/* memcpy(3), memchr(3), strsignal(3) */
+#include <string.h>	/* strsignal(3) */
 
 /* POSIX */
 #include <err.h>	/* Not actually POSIX but should be */
 #include <fcntl.h>	/* Actually fcntl(2), funnily enough */
 #include <signal.h>	/* sigaction(2), kill(2) */
+#include <sys/resource.h> /* getrusage(2) */
 #include <sys/types.h>	/* ssize_t, wait(2), write(2), select(2)... */
-#include <sys/wait.h>	/* wait(2), dumbass */
+#include <sys/uio.h>	/* writev(2) */
+#include <sys/wait.h>	/* wait(2), waitpid(2), dumbass */
 #include <unistd.h>	/* pipe(2), dup2(2), fork(2), execvp(3), write(2),
 			 * read(2) */
 
@@ -74,11 +76,23 @@ foo(const size_t n,
 #include <sys/time.h>	/* sys/types.h and unistd.h already included */
 #endif
 
-#include "column-in-technicolour.h"
+#include "fanout.h"
+#include "libssss.h"
+#include "livetail.h"
+#include "logfile.h"
+#include "metrics.h"
 #include "process_cmdline.h"
+#include "remote.h"
+#include "serve.h"
+#include "sidecar.h"
+#include "sigevent.h"
+#include "statusline.h"
 #include "timestamp.h"
+#include "watchdog.h"
+#include "winsize.h"
 
 /* These must always be the last <#include>s, preferably in this order */
+#include "compat/sdt.h"
 #include "compat/unlocked-stdio.h"
 #include "compat/bool.h"
 #include "compat/inline-restrict.h"
@@ -104,264 +118,473 @@ foo(const size_t n,
 # endif
 #endif
 
-union target {
-	int fd;
-	FILE * fp;
-};
-
-static __inline__ size_t __attribute__((nonnull, __access__(write_only, 3)))
-mkprefix(const unsigned char flags, const int fd, char prefixbuf[TIMESTAMP_SIZE + 3])
-/* Based on flags and fd, writes a prefix to prefixbuf that should prefix
- * each buffalo in buffalo, eg. `[21:34:56.135429]&1 '. Returns the length
- * of the string written to prefixbuf, not including any terminating NUL if
- * there is one, WHICH THERE MAY NOT BE. Do NOT rely on the string written
- * to prefixbuf being NUL-terminated!
- *
- * Fair warning: this function is hyper-optimised
- *
- * If you're wondering about the gratituous use of fwrite(3) where fputs(3)
- * might have been clearer, that's cause fputs_unlocked(3) is not so widely
- * available (see configure.sh)
- *
- * The goto is to ensure that (flags & FLAG_PREFIX) is only tested once
- * Think of it like
- *	if (flags & FLAG_TIMESTAMPS && flags & FLAG_PREFIX)
- *		...
- *	else if (flags & FLAG_TIMESTAMPS)
- *		...
- *	else if (flags & FLAG_PREFIX)
- *		...
- * but marginally less mank
- *
- * TODO: a small thing, but we don't need to keep rechecking flags */
+/* Whether the formatter's output goes through stdio (and the adjusted
+ * buffering described at the top of this file) rather than straight to
+ * writev(2) */
+#define STDIO_FLAGS (FLAG_TIMESTAMPS | FLAG_PREFIX | FLAG_COLUMNS)
+
+/* Bytes in the stdout and stderr buffers, for the write probe */
+static size_t unflushed[2];
+
+/* -m: when what's in them was first put there, or 0 if nothing is; and
+ * buffers big enough to be worth the wait */
+static uint64_t unflushed_since;
+#define COALESCE_BUF (64 * 1024)
+
+/* How long to wait for the rest of the output once the child's exited, if
+ * there's no -d */
+#define DRAIN_MS 1000
+
+/* The child, once parent_listen's reaped it */
+static struct {
+	bool done;
+	int status;
+	uint64_t at;	/* monotonic ns */
+} reaped;
+
+static void clean_up_colour();
+
+static void __attribute__((nonnull(3)))
+write_stdio(void *const ctx, const int ofd,
+		const struct iovec *const iov, const int iovcnt)
+/* ssss_write_fn for -t, -p and -S: into the buffers, to be flushed in
+ * flush_output. If you're wondering about the gratituous use of fwrite(3)
+ * where fputs(3) might have been clearer, that's cause fputs_unlocked(3)
+ * is not so widely available (see configure.sh) */
 {
-	size_t i = 0;
+	FILE *const outstream = ofd == STDOUT_FILENO ? stdout : stderr;
+	int i;
+	for (i = 0; i < iovcnt; i++)
+		unflushed[ofd - 1] += fwrite(iov[i].iov_base, 1, iov[i].iov_len, outstream);
+	if (ctx)
+		fanout_tee(ctx, iov, iovcnt);
+}
 
-	if (flags & FLAG_TIMESTAMPS) {
-		sprint_time(prefixbuf);
-		if (flags & FLAG_PREFIX) {
-			i += TIMESTAMP_SIZE - 2;
-			/* Overwrite trailing ^ space and NUL */
-			goto prefix;
-		} else
-			/* Don't include trailing NUL in return value */
-			return TIMESTAMP_SIZE - 1;
-	}
+static void __attribute__((nonnull(3)))
+write_fd(void *const ctx, const int ofd,
+		const struct iovec *const iov, const int iovcnt)
+/* ssss_write_fn for everything else: real cutely sidestep stdio */
+{
+	const ssize_t n = writev(ofd, iov, iovcnt);
+	PROBE2(write, ofd, n);
+	(void)n;
+	if (ctx)
+		fanout_tee(ctx, iov, iovcnt);
+}
 
-	if (flags & FLAG_PREFIX)
-prefix:		prefixbuf[i++] = '&', prefixbuf[i++] = fd + '0', /* Assumes
-		* that fd < 10; if it isn't, then we're into punctuation */
-		prefixbuf[i++] = ' ';
+static void
+flush_stdio(const int ofd)
+{
+	fflush(ofd == STDOUT_FILENO ? stdout : stderr);
+	PROBE2(write, ofd, unflushed[ofd - 1]);
+	unflushed[ofd - 1] = 0;
+}
 
-	return i;
+static void __attribute__((nonnull))
+flush_output(struct ssss *const fmt, const unsigned char flags, const int fd)
+/* Let out whatever the last drain of fd has left in the formatter or the
+ * stdio buffers; though with -m, the stdio buffers are coalesce's to let
+ * out */
+{
+	ssss_flush(fmt);
+	if (flags & STDIO_FLAGS && !opts.latency_ms)
+		flush_stdio(flags & (FLAG_ALLINONE | FLAG_COLUMNS) ? STDOUT_FILENO : fd);
 }
 
-/* TODO: the two prepend_lines functions need to be merged properly */
-
-static __inline__ void __attribute__((nonnull, __access__(read_only, 2, 3)))
-prepend_lines (
-	FILE *__restrict__ const outstream,
-	const char *__restrict__ unprinted __attribute__((nonstring)),
-	/* I think  ^ this is probably maybe quite possibly OK */
-	size_t n_unprinted,
-	const unsigned char flags
-) {
-	const char *__restrict__ newline_ptr __attribute__((nonstring));
-	/* This one ^ also */
-	char prefixstr[TIMESTAMP_SIZE + 3] __attribute__((nonstring));
-	const size_t prefixn = mkprefix(flags, fileno(outstream), prefixstr);
-	/* Calls gettimeofday(2), ^ so must be called *after* read(2),
-	 * else it delays read(2) too long and fucks up the timing */
-
-	/* Look for a newline anywhere but the last char */
-	while ((newline_ptr = memchr(unprinted, '\n', n_unprinted - 1))) {
-		fwrite(prefixstr, 1, prefixn, outstream);
-		newline_ptr++;
-		n_unprinted -= fwrite(unprinted,
-				1, newline_ptr - unprinted, outstream);
-		unprinted = newline_ptr;
+static void
+coalesce(const bool now)
+/* -m: once a wakeup's output is all in the stdio buffers, out it goes if
+ * now, or if the oldest of it's been waiting -m long, else it waits for
+ * more to go with it. stdio lets it out by itself if the buffers fill */
+{
+	if (!unflushed[0] && !unflushed[1]) {
+		unflushed_since = 0;
+		return;
+	}
+	if (!unflushed_since)
+		unflushed_since = monotonic_ns();
+	if (now || monotonic_ns() - unflushed_since >= (uint64_t)opts.latency_ms * NS_PER_MS) {
+		/* stderr first, as it was read first */
+		if (unflushed[1])
+			flush_stdio(STDERR_FILENO);
+		if (unflushed[0])
+			flush_stdio(STDOUT_FILENO);
+		unflushed_since = 0;
 	}
-
-	/* Once any embedded newlines have been exhausted, print the rest */
-	fwrite(prefixstr, 1, prefixn, outstream);
-	fwrite(unprinted, 1, n_unprinted, outstream);
 }
 
-#define CAT_IN_TECHNICOLOUR(a)\
-	bool a(const int ifd, const union target output_target, const unsigned char flags)
-/* Returns whether ifd is worth listening to anymore (ie. hasn't hit EOF).
- * Also, a whole C++ compiler just for type polymorphism? Bitch */
+/* How much of a stream's output parent_listen will take in one go before
+ * seeing to the other, times its -w weight. A few reads' worth, so the
+ * busy one isn't held up much either */
+#define QUANTUM (8 * BUFSIZ)
+
+/* What cat_in_technicolour left the stream like */
+enum { HUNG_UP, EMPTY, MORE };
 
-static
-CAT_IN_TECHNICOLOUR(cat_in_technicolour_timestamps)
-/* This one outputs to FILE* streams */
+static int __attribute__((nonnull))
+cat_in_technicolour(struct ssss *const fmt, const int ifd, const int fd,
+		long *const deficit)
+/* buffalo buffalo. Reads what ifd (the child's fd) has for us and feeds it
+ * to fmt, until it's empty or we've read *deficit bytes of it (or a bit
+ * over -- it's taken off *deficit either way). Returns one of the above */
 {
-	ssize_t nread;
 	char buf[BUFSIZ] __attribute__((nonstring));
-	bool ret = true;
-
-	/* While this does mean that flags must be rechecked every time this
-	 * is called, I tried the other way and believe it or not it was
-	 * even worse. Also, for compatibility with curse_in_technicolour */
-	const char *__restrict__ colour =
-		(flags & FLAG_COLOUR)
-			? (output_target.fp == stdout ? "\033[32m" : "\033[31m")
-			: NULL;
-	FILE *const outstream = (flags & FLAG_ALLINONE) ? stdout : output_target.fp;
-
-	assert(output_target.fp == stdout || output_target.fp == stderr);
+	ssize_t nread;
 
 	do {
 		nread = read(ifd, buf, BUFSIZ);
+		PROBE2(read, fd, nread);
 		switch (nread) {
 		case -1:
 			if (errno == EAGAIN)
-				goto end;
+				return EMPTY;
 			else
 				err(-1, "read(2)");
 
-		case 0:	close(ifd); ret = false; goto end;
-
+		case 0:
+			ssss_eof(fmt, fd);
+			if (opts.nsinks)
+				fanout_eof(fd);
+			close(ifd);
+			return HUNG_UP;
 		default:
-			if (colour) {
-				fwrite(colour, 1, 5, outstream);
-				colour = NULL; /* No need to keep writing colour */
-			}
-			prepend_lines(outstream, buf, nread, flags);
+			if (opts.remote_addr)
+				remote_feed(fd, buf, nread);
+			if (opts.idle_ms[fd - 1] || opts.kill_ms)
+				watchdog_saw(fd);
+			if (opts.log_path[fd - 1])
+				logfile_feed(fd, buf, nread);
+			/* Timestamps are taken in here, so must be *after*
+			 * read(2), else it delays read(2) too long and fucks
+			 * up the timing */
+			ssss_feed(fmt, fd, buf, nread);
+			if (metrics.fd != -1)
+				metrics_count(fd, nread, ssss_lines(fmt, fd));
+			if (opts.nsinks)
+				fanout_feed(fd, buf, nread);
+			if (opts.index_path)
+				sidecar_note(fd, nread);
+			if (opts.tail_name)
+				livetail_feed(fd, buf, nread);
+			if (opts.status_line)
+				statusline_feed(fd, buf, nread);
+			*deficit -= nread;
 		}
-	} while (nread == BUFSIZ);
+	} while (nread == BUFSIZ && *deficit > 0);
 
-end:	fflush(outstream);
-	return ret;
+	return nread == BUFSIZ ? MORE : EMPTY;
 }
 
-static
-CAT_IN_TECHNICOLOUR(cat_in_technicolour) /* buffalo buffalo */
-/* This one outputs to unix file descriptors */
+static bool
+reap(const bool hang)
+/* waitpid(2) for the child, if it's there to be had, or if hang, until it
+ * is. Returns whether it's been had */
 {
-	/* const everything */
-	const int ofd = (flags & FLAG_ALLINONE) ? STDOUT_FILENO : output_target.fd;
-	const char *__restrict__ const colour =
-		(flags & FLAG_COLOUR)
-			? (output_target.fd == STDOUT_FILENO ? "\033[32m" : "\033[31m")
-			: "";
-
-	/* actual variables we'll be operating on, we need for io */
-	char buf[BUFSIZ] __attribute__((nonstring));
-	ssize_t nread;
-
-	assert(output_target.fd == STDOUT_FILENO || output_target.fd == STDERR_FILENO);
-
-	if (*colour) {
-		const size_t prefixn = 5; /* strlen(colour) */
-		memcpy(buf, colour, prefixn);
-		/* First read will be a special case, reading into buf
-		 * starting after the prefix */
-		nread = read(ifd, buf + prefixn, BUFSIZ - prefixn);
-		nread += prefixn * (nread > 0);
-		goto test_nread; /* Jump into the loop after the read,
-		* having done the special-case first read; subsequent
-		* iterations of the loop will do the regular first read */
-	}
-
-	do {
-		nread = read(ifd, buf, BUFSIZ);
-test_nread:	switch (nread) {
-		case -1:
-			if (errno == EAGAIN)
-				return true;
-			else
-				err(-1, "read(2)");
+	pid_t pid;
+	while ((pid = waitpid(metrics.child, &reaped.status, hang ? 0 : WNOHANG)) == -1
+	       && errno == EINTR)
+		;
+	if (pid <= 0)
+		return false;
+	PROBE2(child__exit, pid, reaped.status);
+	reaped.done = true;
+	reaped.at = monotonic_ns();
+	metrics.child_status = reaped.status;
+	metrics.child_reaped = 1;
+	watchdog_exited();
+	return true;
+}
 
-		case 0:	close(ifd); return false;
-		default:write(ofd, buf, nread);
+static bool
+take_signals(void)
+/* See to whatever signals sigevent has for us. Returns whether the child's
+ * just been reaped */
+{
+	bool exited = false;
+	int sig;
+
+	while ((sig = sigevent_next()))
+		switch (sig) {
+		case SIGCHLD:
+			if (!reaped.done && reap(false))
+				exited = true;
+			break;
+		case SIGWINCH:
+			terminal_resized();
+			if (opts.status_line)
+				statusline_resized();
+			break;
+		case SIGINT:	clean_up_colour(); break;
 		}
-	} while (nread == BUFSIZ);
 
-	return true;
+	return exited;
 }
 
-static __inline__ void
+static void __attribute__((nonnull))
+last_orders(struct ssss *const fmt, const unsigned char flags, const int ifd,
+		const int fd, long deficit)
+/* One last go at a stream that's still open after the child's gone and
+ * the -d grace is up, then it's treated as hung up */
+{
+	if (cat_in_technicolour(fmt, ifd, fd, &deficit) != HUNG_UP) {
+		ssss_eof(fmt, fd);
+		if (opts.nsinks)
+			fanout_eof(fd);
+	}
+	if (~flags & FLAG_COLUMNS)
+		flush_output(fmt, flags, fd);
+}
+
+static void
 parent_listen(const int child_out, const int child_err,
-		const unsigned char flags)
+		const unsigned char flags, void *const tee, const int sigfd)
 {
 	/* whether the respective stream is still worth watching -- a bit
 	 * array of the file descriptors OR'd together. Clever, hey? No */
 	int watch = STDOUT_FILENO | STDERR_FILENO;
 
-	/* ugly stuff for C ```polymorphism''' */
-	union target out_target, err_target;
-
-	/* TODO: some of these make assumptions without accounting for the
-	 * existence of column-in-technicolour.[ch], and so are now
-	 * outdated. Nothing broken, but still */
-
-	/* If -t|-p, points to a more compicated function that uses stdio;
-	 * else points to a slimmer one using only unix io */
-	CAT_IN_TECHNICOLOUR((*const cat_in_technicolour_)) =
-		flags & (FLAG_TIMESTAMPS | FLAG_PREFIX)
-			? cat_in_technicolour_timestamps
-			: cat_in_technicolour;
-
-	/* Beware: cute preprocessor shit. Also, these tests are the same
-	 * as those above but for C variable declaration reasons they are
-	 * tricky to merge, so: Mr. Compiler, optimise these please and
-	 * thank you */
-	if (cat_in_technicolour_ == cat_in_technicolour_timestamps)
-		out_target.fp = stdout, err_target.fp = stderr;
-	else {
-		assert(cat_in_technicolour_ == cat_in_technicolour);
-		out_target.fd = STDOUT_FILENO, err_target.fd = STDERR_FILENO;
-	}
+	/* Deficit round robin: each time round, each stream that's ready
+	 * gets its quantum's worth of reading, plus whatever it didn't get
+	 * through last time if it's still got more. So a firehose on one
+	 * can't keep the other waiting for more than a quantum; if it's
+	 * still going, it'll still be readable, and select(2) comes straight
+	 * back round to it. By fd - 1 */
+	long deficit[2] = { 0, 0 }, quantum[2];
 
-	do {
-		fd_set fds;
-		int fdsn = 1; /* get the increment over with */
+	/* Once the child's exited, when we stop waiting for anything else
+	 * that has its pipes to close them */
+	uint64_t drain_until = 0;
+
+	/* -m: whether to let out what there is as soon as there's nothing
+	 * more to read, rather than waiting: when someone's watching */
+	const bool interactive = opts.latency_ms && isatty(STDOUT_FILENO);
 
+	/* -M: when the wakeup being seen to started */
+	uint64_t woke = 0;
+
+	struct ssss *const fmt = ssss_new(flags,
+		(flags & STDIO_FLAGS || opts.latency_ms) ? write_stdio : write_fd, tee);
+
+	if (opts.group_ms)
+		ssss_set_grouping(fmt, opts.group_ms, opts.group_prefixes);
+	if (metrics.fd != -1)
+		ssss_count_lines(fmt);
+
+	quantum[0] = (opts.weight[0] ? opts.weight[0] : 1) * (long)QUANTUM;
+	quantum[1] = (opts.weight[1] ? opts.weight[1] : 1) * (long)QUANTUM;
+
+	do {
+		fd_set fds, wfds;
+		struct timeval tv;
+		bool more = false; /* whether either stream's got more to read */
+		long ms = -1; /* till something needs doing regardless */
+		int fdsn = sigfd + 1, /* the highest fd in the sets, plus 1 */
+			nready;
+
+		if (!watch) break;
 		FD_ZERO(&fds);
+		FD_ZERO(&wfds);
 		if (watch & STDOUT_FILENO) {
-			fdsn += child_out;
 			FD_SET(child_out, &fds);
+			if (child_out >= fdsn)
+				fdsn = child_out + 1;
 		}
 		if (watch & STDERR_FILENO) {
-			fdsn += child_err;
 			FD_SET(child_err, &fds);
+			if (child_err >= fdsn)
+				fdsn = child_err + 1;
 		}
-		if (fdsn == 1) break;
-		switch (select(fdsn, &fds, NULL, NULL, NULL)) {
+		FD_SET(sigfd, &fds);
+		if (reaped.done)
+			ms = sooner(ms, ms_until(drain_until));
+		if (metrics.fd != -1) {
+			FD_SET(metrics.fd, &fds);
+			if (metrics.fd >= fdsn)
+				fdsn = metrics.fd + 1;
+		}
+		if (opts.remote_addr)
+			ms = sooner(ms, remote_prepare(&fds, &wfds, &fdsn));
+		if (opts.idle_ms[0] || opts.idle_ms[1] || opts.kill_ms)
+			ms = sooner(ms, watchdog_prepare(watch));
+		if (opts.log_path[0] || opts.log_path[1])
+			ms = sooner(ms, logfile_prepare());
+		if (opts.group_ms)
+			ms = sooner(ms, ssss_hold_ms(fmt));
+		if (opts.nsinks) {
+			fanout_prepare(&wfds, &fdsn);
+			if (opts.group_ms)
+				ms = sooner(ms, fanout_hold_ms());
+		}
+		if (opts.status_line)
+			ms = sooner(ms, statusline_prepare());
+		if (unflushed_since)
+			ms = sooner(ms, ms_until(unflushed_since
+				+ (uint64_t)opts.latency_ms * NS_PER_MS));
+
+		if (ms != -1)
+			tv.tv_sec = ms / 1000, tv.tv_usec = ms % 1000 * 1000;
+		switch ((nready = select(fdsn, &fds, &wfds, NULL, ms != -1 ? &tv : NULL))) {
 		case -1:
 			if (errno == EINTR)
 				break;
 			err(-1, "select(2)");
 
-		case 0:	return;
-
 		default:
-			if (flags & FLAG_COLUMNS) {
-				watch = ugly_column_hack(child_out, child_err, flags);
-				break;
-			}
+			/* Including 0: a timeout, with the sets all cleared.
+			 * -M's time seeing to output is by the wakeup, not by
+			 * the write(2): two clock reads a wakeup, not two a
+			 * write */
+			PROBE1(wakeup, nready);
+			if (metrics.fd != -1)
+				woke = monotonic_ns();
+			if (FD_ISSET(sigfd, &fds) && take_signals())
+				drain_until = reaped.at + (uint64_t)(opts.drain_ms
+					? opts.drain_ms : DRAIN_MS) * NS_PER_MS;
+			if (metrics.fd != -1 && FD_ISSET(metrics.fd, &fds))
+				metrics_serve();
+			if (opts.remote_addr)
+				remote_service(&fds, &wfds);
+			if (opts.log_path[0] || opts.log_path[1])
+				logfile_service();
+			if (opts.nsinks)
+				fanout_service(&wfds);
 
 			/* Read from stderr first, that's probably more
-			 * pressing */
-			if (FD_ISSET(child_err, &fds))
-				if (!cat_in_technicolour_(child_err, err_target, flags))
-					watch &= ~STDERR_FILENO;
-			if (FD_ISSET(child_out, &fds))
-				if (!cat_in_technicolour_(child_out, out_target, flags))
-					watch &= ~STDOUT_FILENO;
+			 * pressing. -S pairs up both sides of each row, so
+			 * must wait for both before flushing, and -1 may as
+			 * well, having the one buffer for both */
+			if (FD_ISSET(child_err, &fds)) {
+				deficit[1] += quantum[1];
+				switch (cat_in_technicolour(fmt, child_err, STDERR_FILENO, &deficit[1])) {
+				case HUNG_UP:	watch &= ~STDERR_FILENO; /*@fallthrough@*/
+				case EMPTY:	deficit[1] = 0; /* no saving up */
+						break;
+				case MORE:	more = true;
+				}
+				if (!(flags & (FLAG_COLUMNS | FLAG_ALLINONE)))
+					flush_output(fmt, flags, STDERR_FILENO);
+			}
+			if (FD_ISSET(child_out, &fds)) {
+				deficit[0] += quantum[0];
+				switch (cat_in_technicolour(fmt, child_out, STDOUT_FILENO, &deficit[0])) {
+				case HUNG_UP:	watch &= ~STDOUT_FILENO; /*@fallthrough@*/
+				case EMPTY:	deficit[0] = 0;
+						break;
+				case MORE:	more = true;
+				}
+				if (!(flags & (FLAG_COLUMNS | FLAG_ALLINONE)))
+					flush_output(fmt, flags, STDOUT_FILENO);
+			}
+
+			/* The child's gone, and whatever else has its pipes
+			 * has had long enough: what's there now, and that's
+			 * your lot. Not that the child ever needn't be waited
+			 * for; the likes of `daemon &' are the usual suspects */
+			if (reaped.done && watch && ms_until(drain_until) == 0) {
+				if (watch & STDERR_FILENO)
+					last_orders(fmt, flags, child_err, STDERR_FILENO, quantum[1]);
+				if (watch & STDOUT_FILENO)
+					last_orders(fmt, flags, child_out, STDOUT_FILENO, quantum[0]);
+				if (~flags & FLAG_QUIET)
+					warnx("child exited %.1fs ago, but something still has its output open; not waiting for it",
+						(monotonic_ns() - reaped.at) / 1e9);
+				watch = 0;
+			}
+
+			if (flags & FLAG_COLUMNS) {
+				ssss_set_width(fmt, terminal_width());
+				flush_output(fmt, flags, STDOUT_FILENO);
+			} else if (flags & FLAG_ALLINONE) {
+				/* The both of them, in the order they were
+				 * read, in the one write(2) */
+				flush_output(fmt, flags, STDOUT_FILENO);
+			} else if (opts.group_ms) {
+				/* Groups held long enough may be let out with
+				 * nothing read at all */
+				flush_output(fmt, flags, STDERR_FILENO);
+				flush_output(fmt, flags, STDOUT_FILENO);
+			}
+			if (opts.latency_ms)
+				coalesce(interactive && !more);
+			if (opts.nsinks)
+				fanout_flush();
+			/* Once everything's out, so as not to land in the
+			 * middle of a line of it */
+			if (opts.status_line)
+				statusline_service();
+
+			/* Last, so that anything that came in this time
+			 * counts, and is out before we say there wasn't any */
+			if (opts.idle_ms[0] || opts.idle_ms[1] || opts.kill_ms)
+				watchdog_service(watch);
+			if (metrics.fd != -1)
+				metrics.busy_ns += monotonic_ns() - woke;
 		}
 	} while (watch);
+
+	if (opts.latency_ms)
+		coalesce(true);
+	ssss_free(fmt);
+}
+
+static double
+seconds(const struct timeval *const t)
+{
+	return t->tv_sec + t->tv_usec / 1e6;
+}
+
+static void __attribute__((nonnull))
+report_rusage(const char *__restrict__ const child, const unsigned char flags,
+		const int status, const uint64_t wall_ns)
+/* -u and -U: what the child cost, and what we cost alongside it.
+ * getrusage(2) with RUSAGE_CHILDREN rather than wait4(2), because it's
+ * POSIX, and we only ever have the one child so it comes to the same.
+ * ru_maxrss is in KiB, except on Darwin where it's bytes. Printed even
+ * with -q, since someone asked */
+{
+	struct rusage ru, self;
+	getrusage(RUSAGE_CHILDREN, &ru);
+	getrusage(RUSAGE_SELF, &self);
+
+	if (opts.rusage == REPORT_MACHINE) {
+		fprintf(stderr, "ssss-rusage: %s=%d wall_s=%.6f user_s=%.6f sys_s=%.6f"
+			" maxrss_kb=%ld nvcsw=%ld nivcsw=%ld self_user_s=%.6f"
+			" self_sys_s=%.6f self_maxrss_kb=%ld cmd=%s\n",
+			WIFSIGNALED(status) ? "signal" : "exit",
+			WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status),
+			wall_ns / 1e9, seconds(&ru.ru_utime),
+			seconds(&ru.ru_stime), ru.ru_maxrss, ru.ru_nvcsw,
+			ru.ru_nivcsw, seconds(&self.ru_utime),
+			seconds(&self.ru_stime), self.ru_maxrss, child);
+		return;
+	}
+
+	if (flags & FLAG_TIMESTAMPS) {
+		char timebuf[TIMESTAMP_SIZE];
+		sprint_time(timebuf);
+		fputs(timebuf, stderr);
+	}
+	warnx("%s: %.3fs wall, %.3fs user, %.3fs sys, %ld KiB max RSS, "
+		"%ld+%ld context switches (voluntary+involuntary)",
+		child, wall_ns / 1e9, seconds(&ru.ru_utime),
+		seconds(&ru.ru_stime), ru.ru_maxrss, ru.ru_nvcsw, ru.ru_nivcsw);
+	if (flags & FLAG_VERBOSE)
+		warnx("and ssss itself: %.3fs user, %.3fs sys, %ld KiB max RSS",
+			seconds(&self.ru_utime), seconds(&self.ru_stime),
+			self.ru_maxrss);
 }
 
 static __inline__ int __attribute__((nonnull))
-parent_wait_for_child(const char *__restrict__ const child, const unsigned char flags)
-/* Clean up after child (common parenting experience). Returns $? */
+parent_wait_for_child(const char *__restrict__ const child, const unsigned char flags,
+		const uint64_t started)
+/* Clean up after child (common parenting experience), who main's already
+ * reaped. Returns $? */
 {
-	int child_ret;
+	const int child_ret = reaped.status;
 	char timebuf[TIMESTAMP_SIZE] = ""; /* zero-init */
 
-	wait(&child_ret);
+	if (opts.rusage)
+		report_rusage(child, flags, child_ret, reaped.at - started);
 
 	if (flags & FLAG_TIMESTAMPS && ~flags & FLAG_QUIET)
 		sprint_time(timebuf);
@@ -476,7 +699,7 @@ child_prepare(const char *__restrict__ const cmd, const unsigned char flags,
 			sprint_time(buf);
 			warnx("%sstarting %s", buf, cmd);
 		} else
-			warnx("starting %s", cmd); /* TODO: ripoffline(3X)? */
+			warnx("starting %s", cmd);
 		fflush(stderr);
 	}
 
@@ -498,24 +721,23 @@ parent_prepare(const unsigned char flags,
 	fcntl(child_stderr[0], F_SETFL, O_NONBLOCK);
 
 	/* Last point before colour may be output; take the opportunity to
-	 * register clean_up_colour if necessary */
-	if (flags & FLAG_COLOUR) {
-		struct sigaction clean_up_colour_onsig;
-		clean_up_colour_onsig.sa_handler = (void (*)(int))clean_up_colour,
-		clean_up_colour_onsig.sa_flags = SA_NODEFER;
-		sigemptyset(&clean_up_colour_onsig.sa_mask);
-		if (sigaction(SIGINT, &clean_up_colour_onsig, NULL))
-			warn("sigaction(2)");
-
+	 * register clean_up_colour if necessary. SIGINT's seen to by
+	 * take_signals */
+	if (flags & FLAG_COLOUR)
 		atexit(clean_up_colour);
-	}
 
 	/* If we're going to be using cat_in_technicolour_timestamps,
 	 * change stdio buffer settings; see the top of this file for
 	 * details
 	 *
 	 * Also, beware: more preprocessor sophistry */
-	if (~flags & FLAG_COLUMNS
+	if (opts.latency_ms) {
+		/* -m: everything through stdio, and held there for coalesce */
+		static char buf[2][COALESCE_BUF];
+		setvbuf(stdout, buf[0], _IOFBF, sizeof buf[0]);
+		if (!(flags & (FLAG_ALLINONE | FLAG_COLUMNS)))
+			setvbuf(stderr, buf[1], _IOFBF, sizeof buf[1]);
+	} else if (~flags & FLAG_COLUMNS
 		&& (flags & (FLAG_TIMESTAMPS | FLAG_PREFIX)))
 	{
 		setvbuf(stdout, NULL, _IOFBF, 0);
@@ -528,24 +750,55 @@ int
 main(const int argc, char *const *const argv)
 {
 	int child_stdout[2], child_stderr[2];
+	uint64_t started; /* for -u */
+	void *tee = NULL; /* for -o */
+	int sigfd;
 	const unsigned char flags = process_cmdline(argc, argv);
 
 	/* FIXME: should come before the call to process_cmdline */
 	setlocale(LC_ALL, "");
 
+	if (opts.attach)
+		return livetail_attach(opts.attach, flags);
+	if (opts.serve_path)
+		return serve(opts.serve_path, flags);
+
 	pipe(child_stdout);
 	pipe(child_stderr);
 
+	if (opts.metrics_path)
+		metrics_listen(opts.metrics_path);
+	if (opts.remote_addr)
+		remote_open(opts.remote_addr);
+	if (opts.log_path[0] || opts.log_path[1])
+		logfile_open();
+	if (opts.index_path)
+		sidecar_open(opts.index_path, flags);
+	if (opts.nsinks)
+		tee = fanout_open(flags);
+	if (opts.tail_name)
+		livetail_open(opts.tail_name);
+
 	setup_handle_bad_prog(); /* i.e. handle SIGUSR1. Best do this
 	* before we fork(2), in case of the unlikely event that the child
 	* process gets all the way to sending SIGUSR1 before we're even
 	* prepared */
 
-	switch (fork()) {
+	/* Before fork(2), so that SIGCHLD can't come before we're ready */
+	sigfd = sigevent_open(flags & FLAG_COLOUR || opts.status_line);
+
+	/* All for select(2), as are -M's and -o's, which see to their own */
+	if (child_stdout[0] >= FD_SETSIZE || child_stderr[0] >= FD_SETSIZE
+	    || sigfd >= FD_SETSIZE)
+		errx(-1, "too many files open already for select(2)");
+
+	started = monotonic_ns();
+	switch ((metrics.child = fork())) {
 	case -1:	err(-1, NULL);
 
 	/* Child process */
 	case 0:
+		sigevent_child();
 		child_prepare(argv[optind], flags, child_stdout, child_stderr);
 		execvp(argv[optind], argv + optind);
 		/* If we're here, exec(3) failed; run to parent and tell */
@@ -562,14 +815,36 @@ main(const int argc, char *const *const argv)
 		}
 
 	default:
+		metrics.child_fds[0] = child_stdout[0];
+		metrics.child_fds[1] = child_stderr[0];
+		watchdog_start(argv[optind], metrics.child, flags);
 		parent_prepare(flags, child_stdout, child_stderr);
-		parent_listen(child_stdout[0], child_stderr[0], flags);
+		if (opts.status_line)
+			statusline_open(argv[optind], metrics.child, started, flags);
+		parent_listen(child_stdout[0], child_stderr[0], flags, tee, sigfd);
+		/* Now, if parent_listen hasn't already: -u's wall time is the
+		 * child's, not the child's and however long everything below
+		 * takes to finish up */
+		if (!reaped.done && !reap(true))
+			err(-1, "waitpid(2)");
+		if (opts.remote_addr)
+			remote_finish(1000, flags & FLAG_QUIET);
+		if (opts.log_path[0] || opts.log_path[1])
+			logfile_close();
+		if (opts.index_path)
+			sidecar_close();
+		if (opts.nsinks)
+			fanout_close(1000, flags & FLAG_QUIET);
+		if (opts.tail_name)
+			livetail_close();
+		if (opts.status_line)
+			statusline_close();
 
 		/* cleanup and finishing off */
 		if (flags & FLAG_COLOUR)
 			clean_up_colour();
 
-		return parent_wait_for_child(argv[optind], flags);
+		return parent_wait_for_child(argv[optind], flags, started);
 	}
 }
 
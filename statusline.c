@@ -0,0 +1,254 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>	/* snprintf(3) */
+#include <stdlib.h>	/* atexit(3) */
+#include <string.h>	/* memchr(3), memset(3) */
+
+#include <err.h>
+#include <unistd.h>
+
+#include "libssss.h"
+#include "statusline.h"
+#include "timestamp.h"
+#include "winsize.h"
+
+#include "compat/bool.h"
+#include "compat/inline-restrict.h"
+#include "compat/__attribute__.h"
+
+#define BUSY_MS	250	/* between redraws, while there's anything coming */
+#define IDLE_MS	1000	/* and while there isn't, for the clocks */
+#define MAXLINE	512	/* of the status line, escapes and all */
+
+static struct {
+	bool on;
+	int rows, cols;	/* the status line's on row rows */
+	const char *cmd;
+	pid_t pid;
+	uint64_t started, drawn_at;
+	bool reverse;	/* with -c */
+
+	/* By fd - 1. Counted by statusline_feed, and looked at when
+	 * redrawn: the rates are from the difference since the last time */
+	struct {
+		unsigned long bytes, lines;
+		uint64_t last;	/* when it last said anything; 0 for never */
+		unsigned long drawn_bytes, drawn_lines;
+		double bps, lps;
+	} s[2];
+} st;
+
+static void __attribute__((nonnull))
+emit(const char *buf, size_t n)
+/* Straight to the terminal: stdio's buffer is the output's, and it's been
+ * flushed by the time we're called */
+{
+	while (n) {
+		const ssize_t k = write(STDOUT_FILENO, buf, n);
+		if (k == -1) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		buf += k, n -= k;
+	}
+}
+
+static void
+set_region(const int old_rows)
+/* Keep the bottom row out of the way of the scrolling. The newline first
+ * is in case the cursor's on the bottom row already: then it makes room
+ * by scrolling everything up one, and the cursor's put back on the row
+ * it's on now, which is the one it was on then. Anywhere else, it goes
+ * down one and back up, and nothing's any the wiser */
+{
+	char buf[MAXLINE];
+	int n = 0;
+
+	if (old_rows) {
+		/* Whatever was the status line is just another row now */
+		n = snprintf(buf, sizeof buf, "\0337\033[r\033[%d;1H\033[2K\0338",
+			old_rows);
+	}
+	n += snprintf(buf + n, sizeof buf - n, "\n\0337\033[1;%dr\0338\033[1A",
+		st.rows - 1);
+	emit(buf, n);
+}
+
+static int __attribute__((nonnull))
+human(char *const buf, const size_t size, double bytes)
+{
+	static const char units[][4] = { "B", "KiB", "MiB", "GiB", "TiB" };
+	unsigned i = 0;
+	while (bytes >= 1024 && i < sizeof units / sizeof *units - 1)
+		bytes /= 1024, i++;
+	return snprintf(buf, size, i ? "%.1f %s" : "%.0f %s", bytes, units[i]);
+}
+
+static void
+paint(const uint64_t now)
+{
+	char text[MAXLINE], buf[MAXLINE * 2];
+	const unsigned long secs = (now - st.started) / 1000000000;
+	int n, fd;
+
+	n = snprintf(text, sizeof text, " %s[%ld] %lu:%02lu:%02lu",
+		st.cmd, (long)st.pid, secs / 3600, secs / 60 % 60, secs % 60);
+	for (fd = 0; fd < 2 && n < (int)sizeof text; fd++) {
+		n += snprintf(text + n, sizeof text - n, "  &%d ", fd + 1);
+		if (n >= (int)sizeof text)
+			break;
+		n += human(text + n, sizeof text - n, st.s[fd].bps);
+		if (n >= (int)sizeof text)
+			break;
+		n += st.s[fd].last
+			? snprintf(text + n, sizeof text - n,
+				"/s %.0f lines/s, last %.1fs ago", st.s[fd].lps,
+				(now - st.s[fd].last) / 1e9)
+			: snprintf(text + n, sizeof text - n,
+				"/s %.0f lines/s, nothing yet", st.s[fd].lps);
+	}
+	if (n > (int)sizeof text - 1)
+		n = sizeof text - 1;
+
+	/* Cut to fit, or else padded to fit, for the reverse video to go
+	 * all the way along */
+	if (n > st.cols)
+		n = st.cols;
+	else if (st.reverse && st.cols < (int)sizeof text) {
+		memset(text + n, ' ', st.cols - n);
+		n = st.cols;
+	}
+
+	emit(buf, snprintf(buf, sizeof buf, "\0337\033[%d;1H\033[2K%s%.*s%s\0338",
+		st.rows, st.reverse ? "\033[7m" : "", n, text,
+		st.reverse ? "\033[m" : ""));
+	st.drawn_at = now;
+}
+
+static void
+update(const uint64_t now)
+/* The rates since the last time, half-and-half with what they were then,
+ * so they don't jump about quite so much */
+{
+	const double dt = (now - (st.drawn_at ? st.drawn_at : st.started)) / 1e9;
+	int fd;
+
+	if (dt <= 0)
+		return;
+	for (fd = 0; fd < 2; fd++) {
+		const double bps = (st.s[fd].bytes - st.s[fd].drawn_bytes) / dt,
+			lps = (st.s[fd].lines - st.s[fd].drawn_lines) / dt;
+		st.s[fd].bps = st.drawn_at ? (st.s[fd].bps + bps) / 2 : bps;
+		st.s[fd].lps = st.drawn_at ? (st.s[fd].lps + lps) / 2 : lps;
+		st.s[fd].drawn_bytes = st.s[fd].bytes;
+		st.s[fd].drawn_lines = st.s[fd].lines;
+	}
+}
+
+static __inline__ bool
+busy(void)
+/* Whether there's been anything since the last redraw, or rates left over
+ * from before that are still to come down */
+{
+	return st.s[0].bytes != st.s[0].drawn_bytes
+		|| st.s[1].bytes != st.s[1].drawn_bytes
+		|| st.s[0].bps >= 1 || st.s[1].bps >= 1;
+}
+
+static void
+close_at_exit(void)
+{
+	statusline_close();
+}
+
+extern void __attribute__((nonnull))
+statusline_open(const char *const cmd, const pid_t pid, const uint64_t started,
+		const unsigned char flags)
+{
+	st.rows = terminal_height();
+	st.cols = terminal_width();
+	if (st.rows < 2) {
+		if (~flags & FLAG_QUIET)
+			warnx("-b: terminal's too short for a status line");
+		return;
+	}
+
+	st.on = true;
+	st.cmd = cmd;
+	st.pid = pid;
+	st.started = started;
+	st.reverse = flags & FLAG_COLOUR;
+	atexit(close_at_exit);
+
+	set_region(0);
+	paint(monotonic_ns());
+}
+
+extern void
+statusline_close(void)
+{
+	char buf[MAXLINE];
+
+	if (!st.on)
+		return;
+	st.on = false;
+	emit(buf, snprintf(buf, sizeof buf, "\0337\033[r\033[%d;1H\033[2K\0338",
+		st.rows));
+}
+
+extern void __attribute__((nonnull, __access__(read_only, 2, 3)))
+statusline_feed(const int fd, const char *buf, size_t n)
+{
+	const char *nl;
+
+	st.s[fd - 1].bytes += n;
+	st.s[fd - 1].last = monotonic_ns();
+	while ((nl = memchr(buf, '\n', n))) {
+		st.s[fd - 1].lines++;
+		n -= ++nl - buf;
+		buf = nl;
+	}
+}
+
+extern void
+statusline_resized(void)
+{
+	const int old_rows = st.rows;
+
+	if (!st.on)
+		return;
+	st.rows = terminal_height();
+	st.cols = terminal_width();
+	if (st.rows < 2) {
+		/* Nowhere to put it; leave it be till there is */
+		st.rows = old_rows;
+		return;
+	}
+	/* Only the width, and there's nothing to do but fit it in */
+	if (st.rows != old_rows)
+		set_region(old_rows);
+	paint(monotonic_ns());
+}
+
+extern long
+statusline_prepare(void)
+{
+	if (!st.on)
+		return -1;
+	return ms_until(st.drawn_at
+		+ (uint64_t)(busy() ? BUSY_MS : IDLE_MS) * NS_PER_MS);
+}
+
+extern void
+statusline_service(void)
+{
+	if (st.on && statusline_prepare() == 0) {
+		const uint64_t now = monotonic_ns();
+		update(now);
+		paint(now);
+	}
+}
@@ -0,0 +1,38 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef STATUSLINE_H
+#define STATUSLINE_H
+
+/* -b: a status line on the bottom row of the terminal, with the rest of it
+ * set aside as a scrolling region (DECSTBM) for the output to scroll in
+ * above it, as ripoffline(3X) would, only without curses. It shows PROG's
+ * pid, how long it's been going, and for each stream its bytes and lines
+ * a second and how long since it last said anything. Redrawn at most a few
+ * times a second, and only between writes of ssss' own, so never in the
+ * middle of a line of output */
+
+#include <stddef.h>
+#include <stdint.h>	/* uint64_t */
+#include <sys/types.h>	/* pid_t */
+
+#include "compat/__attribute__.h"
+
+/* In the parent, once there's no more chance of the child going to the
+ * terminal ahead of us. Sees to its own clean-up at exit(3) */
+extern void statusline_open(const char *cmd, pid_t pid, uint64_t started,
+		unsigned char flags) __attribute__((nonnull));
+extern void statusline_close(void);
+
+/* The read path's part: counting, nothing more */
+extern void statusline_feed(int fd, const char *buf, size_t n)
+	__attribute__((nonnull, __access__(read_only, 2, 3)));
+
+/* For SIGWINCH, after terminal_resized */
+extern void statusline_resized(void);
+
+/* ms till the next redraw is due, for select(2)'s timeout; then
+ * statusline_service to do it if it is, once the output's been flushed */
+extern long statusline_prepare(void);
+extern void statusline_service(void);
+
+#endif /* STATUSLINE_H */
@@ -1,8 +1,13 @@
 #include "config.h"
 
+#if _POSIX_C_SOURCE < 199309L
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L
+#endif
+
 #include <stdio.h>	/* snprintf(3) */
 #include <sys/time.h>	/* gettimeofday(2) */
-#include <time.h>	/* localtime(3), strftime(3) */
+#include <time.h>	/* localtime(3), strftime(3), clock_gettime(2) */
 
 #include "timestamp.h"
 
@@ -24,3 +29,32 @@ sprint_time(char buf[TIMESTAMP_SIZE])
 		/* -1 is to overwrite NUL ^^^ */
 		".%06ld] ", t.tv_usec);
 }
+
+/* Unlike the above, these are for newer things, where clock_gettime(2) is
+ * the least of anyone's worries; gettimeofday(2) is there just in case */
+
+extern uint64_t
+monotonic_ns(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+#else
+	return realtime_ns();
+#endif
+}
+
+extern uint64_t
+realtime_ns(void)
+{
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return (uint64_t)t.tv_sec * 1000000000 + (uint64_t)t.tv_usec * 1000;
+}
+
+extern long
+ms_until(const uint64_t when)
+{
+	return ms_between(monotonic_ns(), when);
+}
@@ -3,9 +3,36 @@
 
 #define TIMESTAMP_SIZE (sizeof "[00:00:00.000000] ")
 
+#include <stdint.h>	/* uint64_t */
+
+#include "compat/inline-restrict.h"
 #include "compat/__attribute__.h"
 
+#define NS_PER_MS	1000000
+
 extern void sprint_time(char buf[TIMESTAMP_SIZE])
 	__attribute__((nonnull, __access__(write_only, 1)));
 
+/* Nanoseconds, for measuring intervals and for machine-readable output
+ * respectively. The former is since some arbitrary point */
+extern uint64_t monotonic_ns(void);
+extern uint64_t realtime_ns(void);
+
+/* For select(2) timeouts: ms from now till when (monotonic ns), rounded
+ * up, so as not to wake up just before it; 0 if it's been and gone. And
+ * ms_until, the same from monotonic_ns() */
+static __inline__ long
+ms_between(const uint64_t now, const uint64_t when)
+{
+	return when > now ? (long)((when - now + NS_PER_MS - 1) / NS_PER_MS) : 0;
+}
+extern long ms_until(uint64_t when);
+
+/* Of two timeouts in ms, either of which may be -1 for `never' */
+static __inline__ long
+sooner(const long a, const long b)
+{
+	return a == -1 ? b : b == -1 || a < b ? a : b;
+}
+
 #endif /* TIMESTAMP_H */
@@ -0,0 +1,144 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#include "config.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>	/* strsignal(3) */
+
+#include <err.h>
+#include <signal.h>	/* kill(2) */
+
+#include "libssss.h"	/* FLAG_* */
+#include "process_cmdline.h"
+#include "timestamp.h"
+#include "watchdog.h"
+
+#include "compat/bool.h"
+#include "compat/inline-restrict.h"
+#include "compat/__attribute__.h"
+
+
+static struct {
+	const char *name;
+	pid_t child;
+	unsigned char flags;
+
+	uint64_t last[2];	/* monotonic ns of the last output, by fd - 1 */
+	bool reported[2];	/* whether we've said so since */
+
+	/* -k: where we've got to with the child */
+	enum { ARMED, SIGNALLED, KILLED } stage;
+	uint64_t signalled;	/* monotonic ns, if SIGNALLED */
+} wd;
+
+static void __attribute__((format(printf, 1, 2)))
+notice(const char *const fmt, ...)
+/* Like warnx(3), but always with a timestamp: the whole point is when */
+{
+	char timebuf[TIMESTAMP_SIZE];
+	va_list ap;
+
+	sprint_time(timebuf);
+	fputs(timebuf, stderr);
+	va_start(ap, fmt);
+	vwarnx(fmt, ap);
+	va_end(ap);
+}
+
+static __inline__ uint64_t
+kill_deadline(void)
+/* Silence on both streams counts from whichever spoke last, or from the
+ * signal, whichever's later */
+{
+	uint64_t from = wd.last[0] > wd.last[1] ? wd.last[0] : wd.last[1];
+	if (wd.stage == SIGNALLED && wd.signalled > from)
+		from = wd.signalled;
+	return from + (uint64_t)opts.kill_ms * NS_PER_MS;
+}
+
+extern void __attribute__((nonnull))
+watchdog_start(const char *const name, const pid_t child, const unsigned char flags)
+{
+	wd.name = name;
+	wd.child = child;
+	wd.flags = flags;
+	wd.last[0] = wd.last[1] = monotonic_ns();
+	wd.reported[0] = wd.reported[1] = false;
+	wd.stage = opts.kill_ms ? ARMED : KILLED;
+}
+
+extern void
+watchdog_saw(const int fd)
+{
+	const uint64_t now = monotonic_ns();
+	if (wd.reported[fd - 1]) {
+		wd.reported[fd - 1] = false;
+		if (wd.flags & FLAG_VERBOSE)
+			notice("output on &%d again after %.1fs", fd,
+				(now - wd.last[fd - 1]) / 1e9);
+	}
+	wd.last[fd - 1] = now;
+}
+
+extern void
+watchdog_exited(void)
+{
+	wd.stage = KILLED;
+}
+
+extern long
+watchdog_prepare(const int watch)
+{
+	const uint64_t now = monotonic_ns();
+	long ms = -1;
+	int i;
+
+	for (i = 0; i < 2; i++)
+		if (watch & (i + 1) && opts.idle_ms[i] && !wd.reported[i])
+			ms = sooner(ms, ms_between(now,
+				wd.last[i] + (uint64_t)opts.idle_ms[i] * NS_PER_MS));
+	if (wd.stage != KILLED)
+		ms = sooner(ms, ms_between(now, kill_deadline()));
+
+	return ms;
+}
+
+extern void
+watchdog_service(const int watch)
+{
+	const uint64_t now = monotonic_ns();
+	int i;
+
+	for (i = 0; i < 2; i++)
+		if (watch & (i + 1) && opts.idle_ms[i] && !wd.reported[i]
+		    && now >= wd.last[i] + (uint64_t)opts.idle_ms[i] * NS_PER_MS)
+		{
+			wd.reported[i] = true;
+			if (~wd.flags & FLAG_QUIET)
+				notice("no output on &%d for %gs", i + 1,
+					opts.idle_ms[i] / 1e3);
+		}
+
+	if (wd.stage != KILLED && now >= kill_deadline()) {
+		/* First whatever -k said, then if that didn't do it, the
+		 * big guns */
+		const int sig = wd.stage == ARMED ? opts.kill_sig : SIGKILL;
+
+		if (~wd.flags & FLAG_QUIET)
+#ifdef HAVE_STRSIGNAL
+			notice("no output for %gs; sending %s signal %d: %s",
+				opts.kill_ms / 1e3, wd.name, sig, strsignal(sig));
+#else
+			notice("no output for %gs; sending %s signal %d",
+				opts.kill_ms / 1e3, wd.name, sig);
+#endif
+		if (kill(wd.child, sig))
+			warn("kill(2)");
+
+		if (sig == SIGKILL)
+			wd.stage = KILLED;
+		else
+			wd.stage = SIGNALLED, wd.signalled = now;
+	}
+}
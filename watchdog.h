@@ -0,0 +1,34 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+/* -i and -k: notice when the child goes quiet. -i gives each stream a
+ * threshold, past which we say so on stderr, once per silence; -k gives
+ * the child as a whole a deadline, past which it gets a signal, and then
+ * if it's still quiet that long again, SIGKILL. Driven off the select(2)
+ * timeout in parent_listen, so costs nothing while we're asleep */
+
+#include <sys/types.h>	/* pid_t */
+
+#include "compat/__attribute__.h"
+
+/* Call just after fork(2). name is for messages */
+extern void watchdog_start(const char *name, pid_t child, unsigned char flags)
+	__attribute__((nonnull));
+
+/* Output turned up on fd. Only needs calling if there's an -i for fd, or
+ * a -k */
+extern void watchdog_saw(int fd);
+
+/* For parent_listen, with its bit array of streams still open. Returns
+ * how many ms until watchdog_service needs calling, or -1 for never.
+ * watchdog_service must be called after every select(2), after the reads */
+extern long watchdog_prepare(int watch);
+extern void watchdog_service(int watch);
+
+/* The child's been reaped: its pid's no longer its to be sent -k's
+ * signals at */
+extern void watchdog_exited(void);
+
+#endif /* WATCHDOG_H */
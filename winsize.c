@@ -0,0 +1,114 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h> /* getenv(3), atoi(3) */
+
+#include <err.h>
+
+#ifdef HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#elif defined HAVE_IOCTL_H
+#include <ioctl.h>
+#elif defined HAVE_STROPTS_H
+#include <stropts.h>
+#else
+#define NO_IOCTL
+#endif /* HAVE_SYS_IOCTL_H */
+#include "winsize.h"
+
+#include "compat/__attribute__.h"
+
+/* this is set from TIOCGWINSZ(2const), from a struct winsize .ws_col, an
+ * unsigned short, so it is initialised to a value which it cannot have
+ * been set to */
+static int ncolumns = -1;
+
+/* and likewise .ws_row, set along with it */
+static int nrows = -1;
+
+/* Whether it came from TIOCGWINSZ, and so will want updating on SIGWINCH */
+static int from_tty = 0;
+
+static int
+columns_env(void)
+{
+	const char *const env_ncols = getenv("COLUMNS");
+	const int res = env_ncols ? atoi(env_ncols) : 0;
+	if (res > 0) /* && res < USHRT_MAX ? */
+		return res;
+
+	/* if all else fails, default to the good old */
+	return 80;
+}
+
+static int /* unsigned short, mayhaps? */
+ncolumns_init(void)
+{
+#ifdef TIOCGWINSZ
+	{
+		struct winsize ws;
+		if (ioctl(fileno(stdout), TIOCGWINSZ, &ws) == 0) {
+			from_tty = 1;
+			nrows = ws.ws_row;
+			return ws.ws_col;
+		}
+	}
+	if (errno != ENOTTY)
+		warn("ioctl(2)");
+#endif
+
+	{
+		const char *const env_nrows = getenv("LINES");
+		nrows = env_nrows ? atoi(env_nrows) : 0;
+		if (nrows <= 0)
+			nrows = 24;
+	}
+
+	return columns_env();
+}
+
+extern void
+terminal_resized(void)
+/* Nothing doing if nobody's asked how wide it is yet, or it isn't a
+ * terminal: then it's not our terminal that's been resized */
+{
+#ifdef TIOCGWINSZ
+	struct winsize ws;
+	if (!from_tty)
+		return;
+	if (ioctl(fileno(stdout), TIOCGWINSZ, &ws) == 0)
+		ncolumns = ws.ws_col, nrows = ws.ws_row;
+	else
+		warn("ioctl(2)");
+#endif
+}
+
+extern int
+terminal_width(void)
+{
+	if (ncolumns == -1)
+		ncolumns = ncolumns_init();
+	return ncolumns;
+}
+
+extern int
+terminal_height(void)
+{
+	if (ncolumns == -1)
+		ncolumns = ncolumns_init();
+	return nrows;
+}
+
+extern int
+terminal_width_of(const int fd)
+{
+#ifdef TIOCGWINSZ
+	struct winsize ws;
+	if (ioctl(fd, TIOCGWINSZ, &ws) == 0 && ws.ws_col)
+		return ws.ws_col;
+#endif
+	return columns_env();
+}
@@ -0,0 +1,16 @@
+/* SPDX-FileCopyrightText:  2023-2024 The Remph <lhr@disroot.org>
+   SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef WINSIZE_H
+#define WINSIZE_H
+
+/* Width and height of the terminal on stdout. terminal_resized is for on
+ * SIGWINCH, which is up to the caller to catch */
+extern int terminal_width(void);
+extern int terminal_height(void);
+extern void terminal_resized(void);
+
+/* Width of the terminal on fd, for --serve's clients; if it isn't one,
+ * $COLUMNS or 80, as for stdout */
+extern int terminal_width_of(int fd);
+
+#endif /* WINSIZE_H */